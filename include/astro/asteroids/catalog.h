@@ -19,22 +19,56 @@ namespace asteroids {
 		
 		You can not instantiate this class directly. Instead, use the static member function
 		#openCatalog().
-		
-		\todo Add example code
+
+		Catalogs do positional I/O, and the const readAt() functions
+		share no state: any number of threads may call them at once on a
+		single opened catalog. The other read() functions are not
+		thread-safe, as they keep the position of the next record for
+		read(obj, -1), and build the name index on first use.
+
+		\code
+		std::auto_ptr<Catalog> cat(Catalog::open("astorb.dat", "ASTORB2"));
+
+		// on each worker thread
+		std::vector<Asteroid> obj;
+		cat->readAt(obj, from, to);
+		\endcode
 	*/
 	class Catalog {
 	protected:
+		int cursor;	///< next record to be read by read(obj, -1)
+
 		virtual bool openCatalog(const char *filename, const char *mode) = 0;
 	public:
 		static Catalog *open(const char *filename, const char *type = NULL, const char *mode = "r");
 
+		Catalog() : cursor(0) {}
+
+		/**
+			\name Thread-safe reads
+
+			Read record \a id, records [from, to), or records \a ids (in
+			that order, coalescing nearby ids into range reads). Return 0,
+			the number of records read, or -1 on error.
+		*/
+		//@{
+		virtual int readAt(Asteroid &obj, int id) const = 0;
+		virtual int readAt(std::vector<Asteroid> &obj, int from, int to) const = 0;
+		virtual int readAt(std::vector<Asteroid> &obj, const int *ids, int num) const;
+		virtual int recordCount() const = 0;
+		//@}
+
 		virtual int read(Asteroid &obj, const char *name) = 0;
-		virtual int read(std::vector<Asteroid> &obj, const int from, const int to) = 0;
-		virtual int read(Asteroid &obj, const int id) = 0;
-		virtual int recordCount() = 0;
+		virtual int read(std::vector<Asteroid> &obj, const int from, const int to);
+		/// Read record \a id, or the record following the one last read if \a id is -1
+		virtual int read(Asteroid &obj, const int id);
 
+		/// Read records \a ids into \a obj, in that order. Nearby ids are coalesced into range reads.
 		virtual int read(std::vector<Asteroid> &obj, int *ids, int num);
 
+		/// All recordCount() records of the catalog, in place, for catalogs held in memory (eg. NATIVE-MMAP). NULL for other catalogs.
+		virtual const Asteroid *records() { return NULL; }
+
 		virtual int write(Asteroid &obj, int at) = 0;
 
 		virtual char *identify(char *) = 0;
@@ -0,0 +1,109 @@
+#ifndef _astro_catalogstream_h
+#define _astro_catalogstream_h
+
+#include <astro/asteroids/catalog.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace peyton {
+namespace asteroids {
+
+	/**
+		\brief Streams a catalog in fixed-size chunks, reading ahead on a
+		background thread
+
+		A reader thread fills the next chunk (with Catalog::readAt()) while
+		the caller processes the current one, so I/O and parsing overlap with
+		computation. The two chunk buffers are reused throughout, so a pass
+		over the catalog makes no allocations once they have grown to size.
+
+		The stream is a single pass, input range: a chunk stays valid until
+		the iterator is advanced. Errors reading a chunk are thrown as
+		ECatalog when the iterator reaches it.
+
+		\code
+		CatalogStream cs(*cat, 65536);
+		for(CatalogStream::iterator it = cs.begin(); it != cs.end(); ++it)
+		{
+			const CatalogStream::chunk &c = *it;
+			for(size_t i = 0; i != c.size(); i++) { process(c[i]); }	// record c.from + i
+		}
+
+		// or, in C++11
+		for(const CatalogStream::chunk &c : CatalogStream(*cat)) { ... }
+		\endcode
+	*/
+	class CatalogStream
+	{
+	public:
+		/// a block of consecutive records
+		struct chunk
+		{
+			int from;			///< id of the first record
+			std::vector<Asteroid> obj;	///< the records
+
+			size_t size() const { return obj.size(); }
+			const Asteroid &operator[](size_t i) const { return obj[i]; }
+		};
+
+		class iterator
+		{
+		protected:
+			CatalogStream *s;
+			int k;		///< chunk index
+			friend class CatalogStream;
+			iterator(CatalogStream *s_, int k_) : s(s_), k(k_) {}
+		public:
+			iterator() : s(NULL), k(0) {}
+
+			const chunk &operator*() const { return s->slot[k % 2]; }
+			const chunk *operator->() const { return &s->slot[k % 2]; }
+			iterator &operator++() { s->advance(k); k++; return *this; }
+
+			bool operator==(const iterator &b) const { return k == b.k; }
+			bool operator!=(const iterator &b) const { return k != b.k; }
+		};
+
+	protected:
+		const Catalog &cat;
+		int from, to, chunkLen, nchunks;
+
+		chunk slot[2];		///< chunk k is read into slot[k % 2]
+		bool failed[2];		///< whether reading the chunk in the slot failed
+
+		boost::mutex lock;
+		boost::condition_variable changed;	// signalled when a chunk is read, or released
+		int filled;		///< chunks [0, filled) have been read
+		int released;		///< chunks [0, released) have been processed
+		bool stopping;
+		boost::thread reader;
+
+		void read_ahead();
+		void wait(int k);
+		void advance(int k);
+
+	public:
+		/**
+			Stream records [from, to) of \a cat (to = -1 for all of them)
+			in chunks of \a chunkLen records. Reading starts right away.
+		*/
+		CatalogStream(const Catalog &cat, int chunkLen = 65536, int from = 0, int to = -1);
+		~CatalogStream();
+
+		/// may be called only once
+		iterator begin();
+		iterator end() { return iterator(this, nchunks); }
+	};
+
+} // namespace asteroids
+} // namespace peyton
+
+#define __peyton_asteroids peyton::asteroids
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef _astro_prediction_h
+#define _astro_prediction_h
+
+#include <astro/types.h>
+#include <astro/math/vector.h>
+#include <astro/healpix.h>
+#include <astro/asteroids/asteroid.h>
+#include <astro/asteroids/observation.h>
+#include <astro/asteroids/propagator.h>
+#include <astro/sdss/rungeometry.h>
+
+#include <vector>
+#include <cstddef>
+
+namespace peyton {
+namespace asteroids {
+
+	/**
+		\brief Heliocentric position (AU) and velocity (AU/day) of the
+		Earth-Moon barycenter at \a t, ecliptic J2000
+
+		Computed from the mean elements of Standish (1992, "Keplerian
+		elements for approximate positions of the major planets", valid for
+		1800-2050), to ~20 arcsec in heliocentric longitude. The Earth is up
+		to 3e-5 AU away from the barycenter.
+	*/
+	void earth(MJD t, math::V3 &r, math::V3 &v);
+
+	/**
+		\brief Predicts which asteroids fall in the field of view of SDSS runs
+
+		Rather than propagating every object to the time of each run, the
+		objects are propagated to the epochs of a coarse time grid (one node
+		per \a step days, holding the runs observed closest to it), where
+		their geocentric positions and rates of motion are bucketed into
+		HEALPix cells. For each run, only the objects in the cells near its
+		great circle stripe (the run's Mask, widened by how far an object can
+		move between the grid epoch and the run) are looked at. Those whose
+		coarse (mu, nu) lie close to the stripe are then propagated exactly
+		to the time the scan passes over them, with light-time correction,
+		and kept if they fall within the Mask.
+
+		\code
+		std::vector<Asteroid> obj;
+		cat->read(obj, 0, cat->recordCount());
+
+		FieldPredictor fp(obj);
+		std::vector<Observation> obs;
+		fp.predict(runs, obs);
+		\endcode
+
+		Positions are geocentric (see earth()) and take no account of the
+		observatory's location, so they are good to several arcseconds for
+		nearby objects. Rates of motion (Observation::dra, which includes
+		the cos(dec) factor, and Observation::ddec) are in radians per day.
+		Objects moving faster than \a maxRate at the grid epoch are not
+		bucketed, but tested against every run.
+	*/
+	class FieldPredictor
+	{
+	protected:
+		const Asteroid *obj;
+		size_t n;
+		Propagator prop;
+		coordinates::Healpix hpx;
+
+		double step;		///< spacing of the time grid (days)
+		Radians maxRate;	///< objects moving faster than this (rad/day) are not bucketed
+
+		/// geocentric state of all objects at a grid epoch, bucketed by cell
+		struct snapshot
+		{
+			MJD t;
+			std::vector<math::V3> u;				///< unit vector towards the object (equatorial)
+			std::vector<double> rate;				///< rate of motion (rad/day)
+			std::vector<std::pair<coordinates::Healpix::pixel, size_t> > cells;	///< (cell, object) of slow objects, sorted
+			std::vector<size_t> fast;				///< objects moving faster than maxRate
+		};
+
+		void take_snapshot(MJD t, snapshot &s) const;
+		void predict(const snapshot &s, const sdss::RunGeometry &run, std::vector<Observation> &out) const;
+		bool refine(size_t i, const sdss::RunGeometry &run, sdss::Mask &mask, Radians mu, Observation &o) const;
+
+	public:
+		/**
+			Predict for objects \a obj (which must outlive the predictor),
+			on a time grid of spacing \a step days, propagating on
+			\a nthreads threads (<= 0 for one per core).
+		*/
+		FieldPredictor(const std::vector<Asteroid> &obj, double step = 1., int nthreads = 0);
+		FieldPredictor(const Asteroid *obj, size_t n, double step = 1., int nthreads = 0);
+
+		/// rate of motion above which objects are tested against every run (default: 1 deg/day)
+		void setMaxRate(Radians r) { maxRate = r; }
+
+		/**
+			Append to \a out the observations of objects falling into
+			the Masks of \a runs. Observations are appended run by run,
+			in the order of \a runs, and by time within a run.
+		*/
+		void predict(const std::vector<sdss::RunGeometry> &runs, std::vector<Observation> &out) const;
+		void predict(const sdss::RunGeometry &run, std::vector<Observation> &out) const;
+	};
+
+} // namespace asteroids
+} // namespace peyton
+
+#define __peyton_asteroids peyton::asteroids
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef _astro_propagator_h
+#define _astro_propagator_h
+
+#include <astro/types.h>
+#include <astro/math/vector.h>
+#include <astro/asteroids/asteroid.h>
+
+#include <vector>
+#include <cstddef>
+
+namespace peyton {
+namespace asteroids {
+
+	/**
+		\brief Solution of Kepler's equation, E - e sin E = M, for e < 1
+
+		Uses Markley's (1995, Celest. Mech. 63, 101) non-iterative method:
+		a cubic starter refined by a single fifth order correction, leaving
+		a residual E - e sin E - M below 1e-15 for all M and e. The array
+		version has no data dependent branches.
+	*/
+	Radians kepler(Radians M, double e);
+	void kepler(const double *M, const double *e, double *E, size_t n);
+
+	/**
+		\brief Two-body propagation of the orbits of many objects
+
+		Holds the osculating elements of a set of objects (converted from
+		Asteroid::elements, which are a, e, i, node, argument of perihelion
+		and mean anomaly M at epoch Asteroid::t0) as structure-of-arrays,
+		along with the orientation of each orbit, precomputed once. Objects
+		can then be propagated to any number of epochs, giving heliocentric
+		positions (AU) and velocities (AU/day) in the frame of the elements
+		(ecliptic J2000 for ASTORB; apply coordinates::Transform::eclequ()
+		for equatorial).
+
+		Hyperbolic orbits (e > 1) take |a| as the semimajor axis, and M as
+		the hyperbolic mean anomaly. For parabolic orbits (e == 1),
+		elements[0] must hold the perihelion distance q instead of a, and M is
+		taken to be k (t - T) / sqrt(2 q^3), the right hand side of Barker's
+		equation.
+
+		Elliptic orbits are propagated by branch-free loops over blocks of
+		objects; work is spread over objects and epochs on \a nthreads threads.
+
+		\code
+		std::vector<Asteroid> obj;
+		cat->read(obj, 0, cat->recordCount());
+
+		Propagator prop(obj);
+		std::vector<math::V3> r(prop.size() * nt);
+		prop(&t[0], nt, &r[0]);		// r[j*prop.size() + i]: object i at epoch t[j]
+		\endcode
+	*/
+	class Propagator
+	{
+	protected:
+		size_t n;
+		std::vector<double> a;		///< semimajor axis (|a| for hyperbolic, q for parabolic orbits)
+		std::vector<double> e;		///< eccentricity
+		std::vector<double> ek;		///< eccentricity, 0 for non-elliptic orbits (which are propagated separately)
+		std::vector<double> b;		///< semiminor axis a sqrt(|1 - e^2|)
+		std::vector<double> nn;		///< mean motion (rad/day)
+		std::vector<double> M0;		///< mean anomaly at t0
+		std::vector<double> t0;		///< epoch of the elements (MJD)
+		std::vector<double> P[3];	///< unit vector towards perihelion
+		std::vector<double> Q[3];	///< unit vector in the orbital plane, 90 degrees ahead of P
+		std::vector<size_t> open;	///< indices of non-elliptic orbits
+
+		int nthreads;
+
+		void init(const Asteroid *obj, size_t n);
+
+		/// propagate objects [from, to) to epoch t, storing x[i*stride], ... (v may be NULL)
+		void propagate(MJD t, size_t from, size_t to, double *r, double *v, size_t stride) const;
+		void propagate_open(size_t i, MJD t, double r[3], double v[3]) const;
+		void run(const MJD *t, size_t nt, double *r, double *v, size_t stride, size_t estride) const;
+
+	public:
+		/// propagate objects \a obj, on \a nthreads threads (<= 0 for one per core)
+		Propagator(const std::vector<Asteroid> &obj, int nthreads = 0);
+		Propagator(const Asteroid *obj, size_t n, int nthreads = 0);
+
+		/// number of objects
+		size_t size() const { return n; }
+
+		/// position (and velocity) of object \a i at epoch \a t
+		void operator()(size_t i, MJD t, math::V3 &r, math::V3 &v) const;
+
+		/// positions (and velocities, if \a v is not NULL) of all objects at epoch \a t
+		void operator()(MJD t, math::V3 *r, math::V3 *v = NULL) const;
+		/// all objects at \a nt epochs. Object i at epoch t[j] is stored at r[j*size() + i].
+		void operator()(const MJD *t, size_t nt, math::V3 *r, math::V3 *v = NULL) const;
+	};
+
+} // namespace asteroids
+} // namespace peyton
+
+#define __peyton_asteroids peyton::asteroids
+
+#endif
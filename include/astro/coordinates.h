@@ -3,8 +3,13 @@
 
 #include <astro/types.h>
 #include <astro/constants.h>
+#include <astro/math/vector.h>
+
+#include <boost/shared_ptr.hpp>
 
 #include <string>
+#include <vector>
+#include <cstddef>
 
 namespace peyton {
 /// Functions for manipulating and converting spherical coordinates
@@ -28,9 +33,109 @@ namespace coordinates {
 	/// galgcs - Galactic to SDSS GCS coordinates
 	void galgcs(Radians node, Radians inc, Radians l, Radians b, Radians &mu, Radians &nu);
 
+	/**
+		\brief Array versions of the coordinate transformations.
+
+		Convert n points at a time, without calls into libm (see
+		CoordinatesBatch.cpp). When converting many arrays, or chaining
+		conversions, prefer constructing a Transform once. The float versions compute in double
+		precision, rounding only the result. Longitudes are returned in
+		[0, 2pi), as by the scalar functions. For input angles in
+		[-2pi, 2pi], results agree with those of the scalar functions to
+		2e-15 radians, except above 84 degrees of latitude, where the
+		latitudes returned by the scalar functions lose precision. Larger
+		input angles are reduced differently, and the difference grows in
+		proportion, to ~5e-17 times the angle (3e-11 radians at 6e5). The
+		output arrays may be the same as the input arrays.
+	*/
+	void equgal(const double *ra, const double *dec, double *l, double *b, size_t n);
+	void equgal(const float *ra, const float *dec, float *l, float *b, size_t n);
+	void galequ(const double *l, const double *b, double *ra, double *dec, size_t n);
+	void galequ(const float *l, const float *b, float *ra, float *dec, size_t n);
+	void eclequ(const double *lambda, const double *beta, double *ra, double *dec, size_t n);
+	void eclequ(const float *lambda, const float *beta, float *ra, float *dec, size_t n);
+	void equecl(const double *ra, const double *dec, double *lambda, double *beta, size_t n);
+	void equecl(const float *ra, const float *dec, float *lambda, float *beta, size_t n);
+	void equgcs(Radians node, Radians inc, const double *ra, const double *dec, double *mu, double *nu, size_t n);
+	void equgcs(Radians node, Radians inc, const float *ra, const float *dec, float *mu, float *nu, size_t n);
+	void gcsequ(Radians node, Radians inc, const double *mu, const double *nu, double *ra, double *dec, size_t n);
+	void gcsequ(Radians node, Radians inc, const float *mu, const float *nu, float *ra, float *dec, size_t n);
+
 	typedef void (*transform)(double lambda, double beta, double &ra, double &dec);
 	transform get_transform(const std::string &from, const std::string &to);
 
+	/**
+		\brief A rotation between two spherical coordinate systems.
+
+		Holds the 3x3 rotation matrix taking unit vectors in one coordinate
+		system to the other. The matrix is computed once, when the Transform
+		is constructed; applying it to a point costs one matrix-vector
+		product (plus the conversion to and from spherical coordinates, if
+		given lon/lat). Transforms compose by multiplication, so a chain of
+		conversions costs no more than a single one:
+
+		\code
+		// SDSS GCS of a run to galactic coordinates
+		Transform gcsgal = Transform::equgal() * Transform::gcsequ(node, inc);
+		gcsgal(&mu[0], &nu[0], &l[0], &b[0], n);
+		\endcode
+
+		Longitudes returned by the transform are normalized to [0, 2pi).
+		Accuracy is as for the array versions of the transformation functions
+		(which are implemented in terms of Transform).
+	*/
+	class Transform
+	{
+	protected:
+		double m[3][3];		///< v' = m * v
+
+	public:
+		/// the identity transform
+		Transform();
+		/// the transform with rotation matrix \a m_
+		explicit Transform(const double m_[3][3]);
+
+		/// rotation by \a angle about the x axis
+		static Transform rotx(Radians angle);
+		/// rotation by \a angle about the z axis (adding angle to the longitude)
+		static Transform rotz(Radians angle);
+
+		static Transform equgal();
+		static Transform galequ();
+		static Transform equecl();
+		static Transform eclequ();
+		static Transform equgcs(Radians node, Radians inc);
+		static Transform gcsequ(Radians node, Radians inc);
+
+		/// the composition of two transforms: first \a b, then *this
+		Transform operator*(const Transform &b) const;
+		/// the inverse transform
+		Transform inverse() const;
+
+		/// element (i, j) of the rotation matrix
+		double operator()(int i, int j) const { return m[i][j]; }
+
+		/// transform a (unit) vector
+		math::V3 operator()(const math::V3 &v) const
+		{
+			return math::V3(
+				m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z,
+				m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z,
+				m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z);
+		}
+		/// transform an array of n (unit) vectors. \a out may be the same as \a in.
+		void operator()(const math::V3 *in, math::V3 *out, size_t n) const;
+
+		/// transform a point
+		void operator()(Radians lon, Radians lat, Radians &lon1, Radians &lat1) const;
+		/// transform n points. The output arrays may be the same as the input arrays.
+		void operator()(const double *lon, const double *lat, double *lon1, double *lat1, size_t n) const;
+		void operator()(const float *lon, const float *lat, float *lon1, float *lat1, size_t n) const;
+	};
+
+	/// Transform between the "equ", "gal" and "ecl" coordinate systems. Returns false if either is unknown.
+	bool get_transform(Transform &t, const std::string &from, const std::string &to);
+
 	/// angular distance between two points on a sphere
 	Radians distance(Radians xr1, Radians yr1, Radians xr2, Radians yr2);
 
@@ -44,6 +149,90 @@ namespace coordinates {
 	/// is a point in box. Takes into consideration the compactness of spherical coordinates.
 	bool inBox(Radians ra, Radians dec, Radians ralo, Radians declo, Radians rahi, Radians dechi);
 
+	/**
+		\name Unit-vector representation
+
+		Positions as unit vectors (math::V3), for code that tests many
+		distances or containments. Once converted (unitvec() has an array
+		version that does not call into libm), the tests below cost a dot
+		product or two each, with no trigonometry and no wraparound cases.
+	*/
+	//@{
+	/// unit vector pointing to (lon, lat)
+	inline math::V3 unitvec(Radians lon, Radians lat)
+	{
+		const double cb = cos(lat);
+		return math::V3(cb*cos(lon), cb*sin(lon), sin(lat));
+	}
+	/// unit vectors of n points. Same accuracy as the array coordinate transformations.
+	void unitvec(const double *lon, const double *lat, math::V3 *v, size_t n);
+	void unitvec(const float *lon, const float *lat, math::V3 *v, size_t n);
+
+	/// (lon, lat) of a (not necessarily unit) vector, with lon in [0, 2pi)
+	void lonlat(const math::V3 &v, Radians &lon, Radians &lat);
+	void lonlat(const math::V3 *v, double *lon, double *lat, size_t n);
+
+	/// angular distance between two unit vectors, accurate at all separations
+	inline Radians distance(const math::V3 &a, const math::V3 &b)
+	{
+		return atan2(abs(cross(a, b)), dot(a, b));
+	}
+
+	/**
+		Are unit vectors \a a and \a b within angle r of each other, given
+		\a cosr = cos(r)? Loses precision for r below ~1 mas; see CrossMatch
+		for comparisons based on chord lengths.
+	*/
+	inline bool within(const math::V3 &a, const math::V3 &b, double cosr)
+	{
+		return dot(a, b) >= cosr;
+	}
+
+	/// A spherical cap: all points within a given angle of a center
+	class Cap
+	{
+	public:
+		math::V3 center;	///< unit vector
+		double cosr;		///< cosine of the radius
+
+		Cap(const math::V3 &center_, Radians radius) : center(center_ / abs(center_)), cosr(cos(radius)) {}
+		Cap(Radians lon, Radians lat, Radians radius) : center(unitvec(lon, lat)), cosr(cos(radius)) {}
+
+		bool contains(const math::V3 &v) const { return dot(center, v) >= cosr; }
+		/// test n unit vectors, returning the number inside
+		size_t contains(const math::V3 *v, bool *in, size_t n) const;
+	};
+
+	/**
+		\brief A lon/lat box, as an intersection of half-spaces
+
+		Contains the same points as inBox() with the same arguments: those
+		with lonlo < lon < lonhi, latlo < lat < lathi, the longitude range
+		wrapping through zero if lonhi < lonlo (up to points lying exactly on
+		the edges of the box). The latitude limits become
+		limits on z, the longitude limits planes through the z axis.
+	*/
+	class LonLatBox
+	{
+	protected:
+		double zlo, zhi;		///< sin(latlo), sin(lathi)
+		double ax, ay, bx, by;		///< normals of the planes at lonlo and lonhi (z component is 0)
+		bool wide;			///< range of longitudes wider than pi (either plane suffices)
+
+	public:
+		LonLatBox(Radians lonlo, Radians latlo, Radians lonhi, Radians lathi);
+
+		bool contains(const math::V3 &v) const
+		{
+			if(!(zlo < v.z && v.z < zhi)) { return false; }
+			const bool a = ax*v.x + ay*v.y > 0, b = bx*v.x + by*v.y > 0;
+			return wide ? (a || b) : (a && b);
+		}
+		/// test n unit vectors, returning the number inside
+		size_t contains(const math::V3 *v, bool *in, size_t n) const;
+	};
+	//@}
+
 	/// rotate velocity vector from Great circle coord. sys. to equatorial c.s.
 	void rot_vel(Radians node, Radians inc, Radians mu, Radians nu, Radians vmu, Radians vnu, Radians &vra, Radians &vdec);
 
@@ -60,6 +249,59 @@ namespace coordinates {
 	void formatCoord(const char *fmt, char *out, const double v);
 	/// make a textual representation of coordinates, suitable for MPEC inclusion
 	void formatCoord(char *ras, char *decs, const double ra, const double dec, const int mpec_format = 0);
+	/// formatCoord() for n (ra, dec) pairs
+	void formatCoord(const double *ra, const double *dec, size_t n, std::vector<std::string> &ras, std::vector<std::string> &decs, const int mpec_format = 0);
+
+	/**
+		\brief A pre-parsed formatCoord() format
+
+		Formats values exactly as formatCoord(fmt, out, v) would, but parses
+		\a fmt only once, and formats the fields of the result with
+		io::append_double() (falling back to sprintf only for conversions
+		with multiple flags).
+		Use it when formatting many values:
+
+		\code
+		CoordFormat hms("%02H:%02M:%05.2S");
+		std::vector<std::string> s;
+		hms(&ra[0], n, s);
+		\endcode
+	*/
+	class CoordFormat
+	{
+	protected:
+		struct impl;				///< the parsed format (see Coordinates.cpp)
+		boost::shared_ptr<const impl> p;	///< shared by copies, as it is never modified
+
+	public:
+		explicit CoordFormat(const std::string &fmt);
+
+		/// append the formatted \a v to \a out
+		void append(std::string &out, const double v) const;
+		std::string operator()(const double v) const { std::string s; append(s, v); return s; }
+		void operator()(char *out, const double v) const;
+		/// format n values into \a out
+		void operator()(const double *v, size_t n, std::vector<std::string> &out) const;
+	};
+
+	/**
+		Parse a sexagesimal value, "[+-]aa[ :]bb[ :]cc.ccc", into
+		aa + bb/60 + cc/3600 (negated if there is a minus sign). Leading
+		whitespace is skipped. The last one of the (up to three) components
+		may have a fractional part, and the trailing ones may be omitted
+		("aa bb.bbb", or "aa.aaaa"). Returns a pointer to the first character
+		following the value, or NULL if there is no value at \a s.
+	*/
+	const char *parseSexagesimal(const char *s, double &v);
+	/// parse n strings, each holding a single value, setting v to NaN for those that do not. Returns the number of values parsed.
+	size_t parseSexagesimal(const std::vector<std::string> &s, double *v);
+
+	/// parse ra (in hours) and dec (in degrees), as written by formatCoord(). ra is returned in degrees.
+	bool parseCoord(const char *ras, const char *decs, double &ra, double &dec);
+	/// parseCoord() for n pairs, setting ra and dec to NaN for those that fail to parse. Returns the number of pairs parsed.
+	size_t parseCoord(const std::vector<std::string> &ras, const std::vector<std::string> &decs, double *ra, double *dec);
+	/// parse a line beginning with ra and dec separated by whitespace (eg. "hh mm ss.ss +dd mm ss.s ..."). Returns a pointer past dec, or NULL.
+	const char *parseRaDec(const char *line, double &ra, double &dec);
 }
 
 // backwards compatibility
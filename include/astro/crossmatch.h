@@ -0,0 +1,112 @@
+#ifndef _astro_crossmatch_h
+#define _astro_crossmatch_h
+
+#include <astro/types.h>
+#include <astro/math/vector.h>
+#include <astro/system/memorymap.h>
+
+#include <boost/function.hpp>
+
+#include <vector>
+#include <cstddef>
+
+namespace peyton {
+namespace coordinates {
+
+/**
+	\brief Angular cross-matching of point sets on the sphere
+
+	Builds a 3-d k-d tree over the unit vectors of one set of points (the
+	"index" set), and matches the points of another set against it, on
+	multiple threads. Distances are compared as chord lengths, so no
+	trigonometry is done per candidate pair.
+
+	\code
+	CrossMatch xm(&ra1[0], &dec1[0], n1);		// index the first catalog
+
+	std::vector<CrossMatch::Match> m;
+	xm.match(&ra2[0], &dec2[0], n2, 1*ctn::s2r, m);	// all pairs within 1 arcsec
+	for(size_t i = 0; i != m.size(); i++)
+	{
+		// ra2[m[i].b], dec2[m[i].b] matches ra1[m[i].a], dec1[m[i].a]
+	}
+	\endcode
+
+	Match pairs are produced in the order of the matched points; for each,
+	in no particular order of the indexed points. The k-d tree takes
+	about 33 bytes per indexed point.
+*/
+class CrossMatch
+{
+public:
+	struct Match
+	{
+		size_t a;	///< index of the point in the indexed set
+		size_t b;	///< index of the point in the matched set
+		Radians dist;	///< angular distance between them
+	};
+
+	enum Mode
+	{
+		ALL,		///< all pairs within the radius
+		NEAREST		///< for each matched point, the nearest indexed point within the radius
+	};
+
+	typedef boost::function<void (const std::vector<Match> &)> sink_t;
+
+protected:
+	struct node
+	{
+		math::V3 v;		///< unit vector
+		size_t i;		///< index in the original set
+	};
+
+	std::vector<node> pts;			///< indexed points, in tree order
+	std::vector<unsigned char> dim;		///< split dimension of each (non-leaf) node
+
+	int nthreads;
+	size_t chunk;				///< points per matching job
+
+	size_t split(size_t lo, size_t hi);
+	void build(size_t lo, size_t hi);
+	void build_tree();
+
+	void within(const math::V3 &p, double r2, size_t lo, size_t hi, size_t b, std::vector<Match> &out) const;
+	void nearest(const math::V3 &p, size_t lo, size_t hi, size_t &best, double &best2) const;
+	void match_range(const math::V3 *v, const double *lon, const double *lat, size_t from, size_t to, double r2, Mode mode, std::vector<Match> *out) const;
+	void match(const math::V3 *v, const double *lon, const double *lat, size_t n, Radians radius, Mode mode, const sink_t &sink) const;
+
+public:
+	/// index \a n unit vectors. The tree is built on \a nthreads threads (<= 0 for one per core), which are also used for matching.
+	CrossMatch(const math::V3 *v, size_t n, int nthreads = 0);
+	/// index \a n points given by their longitude and latitude
+	CrossMatch(const double *lon, const double *lat, size_t n, int nthreads = 0);
+
+	/// number of indexed points
+	size_t size() const { return pts.size(); }
+
+	/// indices of all indexed points within \a radius of \a p (a unit vector)
+	void within(const math::V3 &p, Radians radius, std::vector<size_t> &out) const;
+	/// nearest indexed point to \a p within \a radius. Returns false if there is none.
+	bool nearest(const math::V3 &p, Radians radius, size_t &a, Radians &dist) const;
+
+	/**
+		Match \a n points against the index, appending the pairs closer
+		than \a radius to \a out. For \a out other than a vector or a
+		DMMArray, pass a sink which will be called with consecutive batches
+		of matches, in order.
+	*/
+	void match(const math::V3 *v, size_t n, Radians radius, std::vector<Match> &out, Mode mode = ALL) const;
+	void match(const double *lon, const double *lat, size_t n, Radians radius, std::vector<Match> &out, Mode mode = ALL) const;
+	void match(const math::V3 *v, size_t n, Radians radius, system::DMMArray<Match> &out, Mode mode = ALL) const;
+	void match(const double *lon, const double *lat, size_t n, Radians radius, system::DMMArray<Match> &out, Mode mode = ALL) const;
+	void match(const math::V3 *v, size_t n, Radians radius, const sink_t &sink, Mode mode = ALL) const { match(v, NULL, NULL, n, radius, mode, sink); }
+	void match(const double *lon, const double *lat, size_t n, Radians radius, const sink_t &sink, Mode mode = ALL) const { match(NULL, lon, lat, n, radius, mode, sink); }
+};
+
+} // namespace coordinates
+} // namespace peyton
+
+#define __peyton_coordinates peyton::coordinates
+
+#endif
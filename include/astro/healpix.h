@@ -0,0 +1,135 @@
+#ifndef _astro_healpix_h
+#define _astro_healpix_h
+
+#include <astro/types.h>
+#include <astro/math/vector.h>
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace peyton {
+namespace coordinates {
+
+/**
+	\brief HEALPix pixelization of the sphere
+
+	Divides the sphere into 12*nside^2 pixels of equal area, nside = 2^order
+	(0 <= order <= 29), numbered in either the NEST (hierarchical; pixel p
+	at order k contains pixels 4p .. 4p+3 at order k+1) or the RING scheme
+	(Gorski et al. 2005, ApJ 622, 759). Numbering agrees with the reference
+	HEALPix implementation.
+
+	Positions are given either as (lon, lat) (eg. ra, dec) or as unit
+	vectors, and all conversions have array versions. Region queries return
+	the pixels touching a disc, a convex polygon or a lon/lat box as sorted,
+	disjoint ranges of pixel numbers, so that objects stored sorted by
+	pixel can be looked up without a full scan:
+
+	\code
+	Healpix hpx(10);	// nside = 1024, ~3.4 arcmin pixels
+	std::vector<Healpix::pixel> pix(n);
+	hpx.ang2pix(&ra[0], &dec[0], &pix[0], n);
+	// ... sort the objects by pix ...
+
+	std::vector<Healpix::range> ranges;
+	hpx.query_disc(center, 0.5*ctn::d2r, ranges);
+	for(size_t i = 0; i != ranges.size(); i++)
+	{
+		// objects with ranges[i].first <= pix < ranges[i].second
+	}
+	\endcode
+*/
+class Healpix
+{
+public:
+	enum Scheme { RING, NEST };
+
+	typedef long long pixel;
+	typedef std::pair<pixel, pixel> range;		///< pixels [first, second)
+
+protected:
+	int order_;
+	Scheme scheme_;
+	pixel nside_, npface_, ncap_, npix_;
+	double fact1_, fact2_;
+
+	pixel xyf2nest(int ix, int iy, int face) const;
+	void nest2xyf(pixel pix, int &ix, int &iy, int &face) const;
+	pixel xyf2ring(int ix, int iy, int face) const;
+	void ring2xyf(pixel pix, int &ix, int &iy, int &face) const;
+	pixel xyf2pix(int ix, int iy, int face) const { return scheme_ == NEST ? xyf2nest(ix, iy, face) : xyf2ring(ix, iy, face); }
+	void pix2xyf(pixel pix, int &ix, int &iy, int &face) const { if(scheme_ == NEST) nest2xyf(pix, ix, iy, face); else ring2xyf(pix, ix, iy, face); }
+
+	pixel loc2pix(double z, double phi, double sth, bool have_sth) const;
+	void pix2loc(pixel pix, double &z, double &phi, double &sth, bool &have_sth) const;
+
+public:
+	/// pixelization with nside = 2^order
+	explicit Healpix(int order, Scheme scheme = NEST);
+
+	int order() const { return order_; }
+	Scheme scheme() const { return scheme_; }
+	pixel nside() const { return nside_; }
+	pixel npix() const { return npix_; }
+
+	/// maximum angular distance between a pixel center and its corners
+	Radians max_pixrad() const;
+
+	/// pixel containing the point
+	pixel ang2pix(Radians lon, Radians lat) const;
+	pixel vec2pix(const math::V3 &v) const;
+
+	/// center of the pixel
+	void pix2ang(pixel pix, Radians &lon, Radians &lat) const;
+	math::V3 pix2vec(pixel pix) const;
+
+	void ang2pix(const double *lon, const double *lat, pixel *pix, size_t n) const;
+	void vec2pix(const math::V3 *v, pixel *pix, size_t n) const;
+	void pix2ang(const pixel *pix, double *lon, double *lat, size_t n) const;
+	void pix2vec(const pixel *pix, math::V3 *v, size_t n) const;
+
+	/// the four corners of the pixel, in N, W, S, E order
+	void corners(pixel pix, math::V3 c[4]) const;
+
+	/**
+		The eight neighbours of the pixel, in SW, W, NW, N, NE, E, SE, S
+		order. Where a neighbour does not exist (only the case for a few
+		pixels next to the corners of the base pixels), it is set to -1.
+	*/
+	void neighbours(pixel pix, pixel nb[8]) const;
+
+	pixel nest2ring(pixel pix) const;
+	pixel ring2nest(pixel pix) const;
+
+	/**
+		\name Region queries
+
+		Store into \a out the pixels whose area overlaps the region, as
+		sorted, disjoint ranges. The search is hierarchical and conservative:
+		a few pixels touching the region's bounding area (but not the region
+		itself) may be returned as well, but no overlapping pixel is ever
+		omitted. If \a inclusive is false, only the pixels whose centers lie
+		within the region are returned instead.
+	*/
+	//@{
+	/// pixels within \a radius of \a center
+	void query_disc(const math::V3 &center, Radians radius, std::vector<range> &out, bool inclusive = true) const;
+	/// pixels within the convex spherical polygon with vertices \a v (in either order)
+	void query_polygon(const std::vector<math::V3> &v, std::vector<range> &out, bool inclusive = true) const;
+	/// pixels within the box lonlo <= lon <= lonhi, latlo <= lat <= lathi (lonhi < lonlo if the box wraps around)
+	void query_box(Radians lonlo, Radians latlo, Radians lonhi, Radians lathi, std::vector<range> &out, bool inclusive = true) const;
+	//@}
+
+	/// Region for the hierarchical queries (see Healpix.cpp)
+	struct region;
+protected:
+	void query(const region &r, std::vector<range> &out, bool inclusive) const;
+};
+
+} // namespace coordinates
+} // namespace peyton
+
+#define __peyton_coordinates peyton::coordinates
+
+#endif
@@ -49,24 +49,16 @@ namespace io {
 }
 
 //
-// STL forward declarations
+// STL containers with binary I/O support. These are included rather than
+// forward declared, as the standard library may define them in an inline
+// namespace (eg. std::__cxx11::list), which makes a forward declaration
+// in std ambiguous.
 //
-namespace std
-{
-	// Sequences
-	template<typename T, typename A> class vector;
-	template<typename T, typename A> class deque;
-	template<typename T, typename A> class list;
-
-	// Associative Containers
-	template<typename T, typename C, typename A> class set;
-	template<typename T, typename C, typename A> class multiset;
-	template<typename K, typename V, typename C, typename A> class map;
-	template<typename K, typename V, typename C, typename A> class multimap;
-
-	// Numerics
-	template<typename T> class valarray;
-}
+#include <deque>
+#include <list>
+#include <set>
+#include <map>
+#include <valarray>
 
 //
 // Automatically mark a std::pair of PODs as a POD
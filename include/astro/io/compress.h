@@ -3,12 +3,41 @@
 
 #include <astro/exceptions.h>
 
+#include <string>
+#include <vector>
+
 namespace peyton {
 namespace io {
 namespace compress {
 
-	/// gzip a file given in variable \a path
-	void gzip(const std::string &path) throw(peyton::exceptions::EIOException);
+	/// default input block size for (parallel) compression
+	const size_t default_blocksize = 128*1024;
+
+	/**
+		gzip a file given in variable \a path, in the manner of <tt>gzip -f</tt>:
+		the result is written to \a path.gz (overwriting it if it exists) and
+		the original file is removed. The permissions and the access and
+		modification times of the original are carried over to \a path.gz.
+
+		Compression is done in-process, at zlib level \a level. If \a nthreads
+		is different from 1, the file is cut into \a blocksize chunks which are
+		compressed in parallel by \a nthreads threads (<= 0 means one per core).
+		The output is first written to a temporary file, which is atomically
+		renamed to \a path.gz once complete.
+	*/
+	void gzip(const std::string &path, int level = 6, int nthreads = 1, size_t blocksize = default_blocksize)
+		throw(peyton::exceptions::EIOException);
+
+	/**
+		gzip a batch of files, each one as if by gzip(path, level, 1).
+
+		Files are compressed concurrently by a pool of \a nthreads threads
+		(<= 0 means one per core). All files are processed even if some of
+		them fail, after which a single EIOException listing the failures is
+		thrown.
+	*/
+	void gzip(const std::vector<std::string> &paths, int level = 6, int nthreads = 0, size_t blocksize = default_blocksize)
+		throw(peyton::exceptions::EIOException);
 
 }
 }
@@ -2,6 +2,7 @@
 #define fpnumber_h_
 
 #include <iosfwd>
+#include <cstddef>
 
 namespace peyton {
 namespace io {
@@ -42,6 +43,29 @@ namespace io {
 	double bitunpack(int m, int k, unsigned v);
 	unsigned bitpack(int m, int k, double x);
 
+	/// status codes returned by the array versions of bitpack() and bitunpack()
+	enum bitpack_status
+	{
+		BP_OK = 0,		///< success
+		BP_NEGATIVE = -1,	///< a value was negative (or NaN)
+		BP_OVERFLOW = -2,	///< a value was (or would round to) 1 or more
+		BP_UNDERFLOW = -3,	///< a value was too small for the exponent range
+		BP_FORMAT = -4		///< m and k do not describe a valid format
+	};
+
+	/**
+		Pack \a n values from \a x into \a v, using a format with an \a m bit
+		mantissa and a \a k bit exponent (or, for k = 0, an m bit fixed point
+		fraction). All values must lie in [0, 1).
+
+		Returns BP_OK on success. Otherwise, packing stops at the first value
+		which cannot be represented, an error code is returned, and the index
+		of the offending value is stored into \a bad (if given).
+	*/
+	int bitpack(int m, int k, const double *x, unsigned *v, size_t n, size_t *bad = NULL);
+	/// Unpack \a n values packed by bitpack() from \a v into \a x
+	int bitunpack(int m, int k, const unsigned *v, double *x, size_t n);
+
 }
 }
 
@@ -141,7 +141,12 @@ namespace gzstream
 	@param buf Buffer to read from.
 	@param n Size of the buffer to write out. 
 	@return # of characters writen. */
-    std::streamsize xsputn(char_type* buf, std::streamsize n);
+    std::streamsize xsputn(const char_type* buf, std::streamsize n);
+    /** Set the size of zlib's internal buffers (must be called
+	before the first read or write).
+	@param size Buffer size, in bytes.
+	@return true on success */
+    bool buffer(unsigned size);
     /** Syncronise the stream. 
 	@return EOF on error. */
     int sync();
@@ -262,12 +267,24 @@ namespace gzstream
   //__________________________________________________________________
   template <typename Char_Type, typename Traits>
   std::streamsize 
-  basic_file<Char_Type, Traits>::xsputn(basic_file::char_type* buf, 
+  basic_file<Char_Type, Traits>::xsputn(const basic_file::char_type* buf, 
 					std::streamsize n) 
   {
     return gzwrite(_file, buf, sizeof(char_type) * n);
   }
 
+  //__________________________________________________________________
+  template <typename Char_Type, typename Traits>
+  bool
+  basic_file<Char_Type, Traits>::buffer(unsigned size) 
+  {
+#if ZLIB_VERNUM >= 0x1240
+    return gzbuffer(_file, size) == 0;
+#else
+    return false;
+#endif
+  }
+
   //__________________________________________________________________
   template <typename Char_Type, typename Traits>
   typename basic_file<Char_Type, Traits>::pos_type
@@ -334,7 +351,7 @@ namespace gzstream
     if (i  && !o && !t && !a)   rw[0] = 'r';
     if (i  && o  && !t && !a) { rw[0] = 'r'; rw[1] = '+'; }
     if (i  && o  && t  && a)  { rw[0] = 'w'; rw[1] = '+'; }
-    if (b)                      rw[0] = 'b';
+    if (b)                      rw[rw[1] ? 2 : 1] = 'b';
 
     if (!(_file = gzopen(name, rw))) return 0;
   
@@ -347,9 +364,12 @@ namespace gzstream
   basic_file<Char_Type, Traits>* 
   basic_file<Char_Type, Traits>::close() 
   {
-    if (!_created || !gzclose(_file))
+    if (!is_open()) 
       return 0;
-    return this;
+    bool ok = !_created || gzclose(_file) == Z_OK;
+    _file    = NULL;
+    _created = false;
+    return ok ? this : 0;
   }
 
 }
@@ -57,22 +57,34 @@ namespace gzstream
     streambuf_type _buf;
   public: 
     /// Create new stream
-    basic_iostream() : stream_type(&_buf), _buf(0) {}
+    basic_iostream() : stream_type(&_buf), _buf() {}
     /** Create new stream from a pointer a zlib @c gzFile
-	@param fp the zlib @c gzFile pointer. */
-    basic_iostream(gzFile fp) : stream_type(&_buf), _buf(fp) {}
+	@param fp the zlib @c gzFile pointer. 
+	@param bufsize Size of the I/O buffers, in characters. */
+    basic_iostream(gzFile fp, std::size_t bufsize = streambuf_type::default_bufsize) 
+      : stream_type(&_buf), _buf(fp, bufsize) {}
     /** Create new stream from a filename
-	@param fn the filename. */
-    basic_iostream(const char *fn) : stream_type(&_buf), _buf(fn, mode) {}
+	@param fn the filename. 
+	@param bufsize Size of the I/O buffers, in characters (e.g.,
+	a few MB for fast bulk binary reads). */
+    basic_iostream(const char *fn, std::size_t bufsize = streambuf_type::default_bufsize) 
+      : stream_type(&_buf), _buf(fn, mode, bufsize) {}
     /** Open new stream from a filename
     @param fn the filename. */
     void open(const char* fn, std::ios_base::openmode _mode = mode)
     {
-	_buf.open(fn, _mode);
+	if (!_buf.open(fn, _mode)) this->setstate(std::ios::failbit);
     }
+    /** Close the stream. */
+    void close()
+    {
+	if (!_buf.close()) this->setstate(std::ios::failbit);
+    }
+    /** Test if the stream is open. */
+    bool is_open() const { return _buf.is_open(); }
     /** Get the streambuffer.
 	@return A pointer to the streambuf object */
-    streambuf_type* rdbuf() const { return &_buf; }
+    streambuf_type* rdbuf() const { return const_cast<streambuf_type*>(&_buf); }
     /** Get a pointer to the zlib @c gzFile object.
 	@return A Pointer to the zlib @c gzFile object. */
     operator gzFile () { return _buf; }
@@ -0,0 +1,154 @@
+#ifndef __astro_io_gzstream_index_h
+#define __astro_io_gzstream_index_h
+
+#include <boost/shared_ptr.hpp>
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace peyton {
+namespace io {
+namespace gzstream {
+
+/**
+	\brief Random access index into a gzip file
+
+	An index is a list of access points, spaced roughly \a span bytes apart
+	in the uncompressed stream (in the manner of zlib's zran.c example). Each
+	access point records the compressed and uncompressed offsets of a deflate
+	block boundary, together with the 32k of uncompressed data preceding it,
+	which is everything needed to restart decompression at that point.
+
+	The index is usually built once and stored next to the compressed file
+	(see sidecar()), from where seekable_streambuf picks it up. Because an
+	index is immutable once built, a single instance may be shared between
+	any number of streams (and threads) reading the same file -- this is
+	how to decompress disjoint ranges of a .gz file in parallel.
+
+	Only the first member of multi-member (concatenated) gzip files is indexed.
+*/
+class gzindex
+{
+public:
+	enum { winsize = 32768 };
+	static const unsigned long long default_span = 1 << 20;
+
+	struct point
+	{
+		unsigned long long out;		///< offset in the uncompressed stream
+		unsigned long long in;		///< offset in the compressed file of the first full byte
+		int bits;			///< number of bits (1-7) of the preceding byte belonging to this block, or 0
+		unsigned char window[winsize];	///< uncompressed data preceding this point
+	};
+
+	std::deque<point> points;
+	unsigned long long span;	///< requested access point spacing
+	unsigned long long length;	///< total length of the uncompressed stream
+	unsigned long long csize;	///< size of the indexed compressed file (used to detect stale indices)
+	long long cmtime;		///< its modification time, in ns (likewise)
+
+public:
+	gzindex() : span(default_span), length(0), csize(0), cmtime(0) {}
+
+	/// scan the gzip file \a gzfn, creating an access point every \a span_ uncompressed bytes
+	bool build(const std::string &gzfn, unsigned long long span_ = default_span);
+	/// load an index saved with save(). If \a gzfn is given, check the index matches it (by size and modification time).
+	bool load(const std::string &idxfn, const std::string &gzfn = "");
+	bool save(const std::string &idxfn) const;
+
+	/// access point from which to start decompressing in order to reach \a offset
+	const point &locate(unsigned long long offset) const;
+
+	/// default name of the index file for the gzip file \a gzfn
+	static std::string sidecar(const std::string &gzfn) { return gzfn + ".idx"; }
+};
+
+typedef boost::shared_ptr<const gzindex> pgzindex;
+
+/**
+	\brief Seekable input stream buffer over gzip files
+
+	Reads a gzip file, using a gzindex to implement seekoff()/seekpos() by
+	restarting decompression at the nearest preceding access point. Seeking
+	forward by less than the index span simply decompresses through.
+*/
+class seekable_streambuf : public std::streambuf
+{
+protected:
+	FILE *fp;
+	pgzindex idx;
+
+	z_stream zs;
+	bool zinit;			///< zs has been initialized
+	bool zend;			///< end of the deflate stream was reached
+
+	std::vector<char> inbuf, outbuf;
+	unsigned long long pos;		///< uncompressed offset corresponding to eback()
+
+	bool restart(const gzindex::point &p);
+	bool skip(unsigned long long n);
+
+protected:
+	virtual int_type underflow();
+	virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode mode = std::ios::in);
+	virtual pos_type seekpos(pos_type p, std::ios_base::openmode mode = std::ios::in);
+
+public:
+	seekable_streambuf(size_t bufsize = 256*1024);
+	virtual ~seekable_streambuf();
+
+	/**
+		Open a gzip file for reading. If \a index is not given, the index is
+		loaded from the sidecar file or, failing that, built (and saved to
+		the sidecar, if possible) when \a build is true.
+	*/
+	seekable_streambuf *open(const char *fn, pgzindex index = pgzindex(), bool build = true,
+		unsigned long long span = gzindex::default_span);
+	seekable_streambuf *close();
+	bool is_open() const { return fp != NULL; }
+
+	/// the index in use, for sharing with other streams over the same file
+	pgzindex index() const { return idx; }
+};
+
+/**
+	\brief Seekable gzip input stream
+
+	\code
+	gzstream::seekable_ifstream in("catalog.txt.gz");
+	in.seekg(1000000000);
+	std::getline(in, line);
+	\endcode
+*/
+class seekable_ifstream : public std::istream
+{
+protected:
+	seekable_streambuf _buf;
+public:
+	seekable_ifstream() : std::istream(&_buf) {}
+	seekable_ifstream(const char *fn, pgzindex index = pgzindex(), bool build = true)
+		: std::istream(&_buf) { open(fn, index, build); }
+
+	void open(const char *fn, pgzindex index = pgzindex(), bool build = true)
+	{
+		if(!_buf.open(fn, index, build)) { setstate(std::ios::failbit); }
+	}
+	void close() { if(!_buf.close()) { setstate(std::ios::failbit); } }
+	bool is_open() const { return _buf.is_open(); }
+
+	pgzindex index() const { return _buf.index(); }
+	seekable_streambuf* rdbuf() const { return const_cast<seekable_streambuf *>(&_buf); }
+};
+
+} // namespace gzstream
+} // namespace io
+} // namespace peyton
+
+#define __peyton_io peyton::io
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef __astro_io_gzstream_parallel_h
+#define __astro_io_gzstream_parallel_h
+
+#include <astro/system/threadpool.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace peyton {
+namespace io {
+namespace gzstream {
+
+/**
+	\brief Output stream buffer compressing to gzip format on a pool of threads
+
+	Modeled after pigz: the output is cut into independent blocks of
+	\a blocksize bytes, each of which is deflated by a worker thread. Every
+	block is primed with the last 32k of the preceding block as its preset
+	dictionary, so the compression ratio stays close to that of serial
+	gzip. Blocks are terminated with a sync flush (the last one with a
+	finish), concatenated in order and wrapped in a single gzip header and
+	trailer. The result is a standard, single-member .gz file readable by
+	gzip, zlib or gzstream::ifstream.
+
+	At most 2*nthreads blocks are in flight at any time, bounding the memory
+	use to about 4*nthreads*blocksize bytes.
+*/
+class parallel_streambuf : public std::streambuf
+{
+public:
+	enum { dictsize = 32768 };
+	static const size_t default_blocksize = 128*1024;
+protected:
+	struct block
+	{
+		std::vector<char> in;		///< uncompressed data
+		std::vector<char> dict;		///< preset dictionary (tail of the previous block)
+		std::vector<char> out;		///< raw deflate output
+		size_t len;			///< length of the uncompressed data
+		uLong crc;			///< crc32 of the uncompressed data
+		bool last;			///< finish the deflate stream with this block
+		bool done;			///< set by the worker once compressed
+		bool failed;
+
+		block() : len(0), crc(0), last(false), done(false), failed(false) {}
+	};
+	typedef boost::shared_ptr<block> pblock;
+
+	FILE *fp;
+	std::string filename;
+	int level;
+	size_t blocksize;
+
+	boost::mutex lock;
+	boost::condition_variable completed;
+	peyton::system::ThreadPool pool;
+	std::deque<pblock> pending;	///< blocks submitted but not yet written out, in stream order
+
+	std::vector<char> buf;		///< block being filled (the put area)
+	std::vector<char> dict;		///< last dictsize bytes of input (for priming the next block)
+	uLong crc;			///< running crc32 of the whole stream
+	unsigned long long isize;	///< running length of the uncompressed stream
+	bool err;
+
+	void compress(pblock b);
+	bool submit(bool last);
+	bool write_front();
+	bool drain(size_t maxpending);
+	bool put(const void *data, size_t len);
+	void reset_put_area();
+
+	bool write_header();
+	bool write_trailer();
+
+protected:
+	virtual int_type overflow(int_type c = traits_type::eof());
+	virtual int sync();
+
+public:
+	/**
+		Create a stream buffer compressing at zlib level \a level,
+		with \a nthreads workers (<= 0 means one per core) and
+		\a blocksize bytes of input per independently compressed block.
+	*/
+	parallel_streambuf(int level = Z_DEFAULT_COMPRESSION, int nthreads = 0, size_t blocksize = default_blocksize);
+	parallel_streambuf(const char *fn, int level = Z_DEFAULT_COMPRESSION, int nthreads = 0, size_t blocksize = default_blocksize);
+	virtual ~parallel_streambuf();
+
+	parallel_streambuf *open(const char *fn);
+	parallel_streambuf *close();
+	bool is_open() const { return fp != NULL; }
+
+	int threads() const { return pool.size(); }
+};
+
+/**
+	\brief gzip output stream compressing on multiple threads
+
+	\code
+	gzstream::pofstream out("catalog.txt.gz", 9);
+	out << lots_of_data;
+	\endcode
+*/
+class pofstream : public std::ostream
+{
+protected:
+	parallel_streambuf _buf;
+public:
+	pofstream(int level = Z_DEFAULT_COMPRESSION, int nthreads = 0, size_t blocksize = parallel_streambuf::default_blocksize)
+		: std::ostream(&_buf), _buf(level, nthreads, blocksize) {}
+	pofstream(const char *fn, int level = Z_DEFAULT_COMPRESSION, int nthreads = 0, size_t blocksize = parallel_streambuf::default_blocksize)
+		: std::ostream(&_buf), _buf(level, nthreads, blocksize) { open(fn); }
+
+	void open(const char *fn) { if(!_buf.open(fn)) { setstate(std::ios::failbit); } }
+	void close() { if(!_buf.close()) { setstate(std::ios::failbit); } }
+	bool is_open() const { return _buf.is_open(); }
+
+	parallel_streambuf* rdbuf() const { return const_cast<parallel_streambuf *>(&_buf); }
+};
+
+} // namespace gzstream
+} // namespace io
+} // namespace peyton
+
+#define __peyton_io peyton::io
+
+#endif
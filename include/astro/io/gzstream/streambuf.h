@@ -33,6 +33,7 @@
 #ifndef __IOSTREAM__
 # include <iostream>
 #endif
+#include <vector>
 
 /** @file   streambuf.h
     @author Christian Holm
@@ -45,6 +46,10 @@ namespace gzstream
 {
   //==================================================================
   /** Basic zlib gzFile stream buffer. 
+      Reads and writes go through a get/put area of a configurable
+      size. Bulk reads and writes (@c read() and @c write() calls on
+      the stream) at least as large as the buffer bypass it, and are
+      inflated (deflated) directly to (from) the caller's memory.
       @param T The kind of streambuf to derive from.  Should be a
       sub-class of std::streambuf
       @ingroup gzstream
@@ -67,40 +72,49 @@ namespace gzstream
     typedef typename traits_type::pos_type       pos_type;
     /// The offset type
     typedef typename traits_type::off_type       off_type;
+    /// Default buffer size, in characters 
+    enum { default_bufsize = 128*1024 };
   private:
     /// The underlying zlib gzFile abstraction layer. 
     file_type _file;
+    /// Size of the get and put areas, in characters 
+    std::size_t _bufsize;
+    /// Get area (allocated on first read)
+    std::vector<char_type> _gbuf;
+    /// Put area (allocated on first write) 
+    std::vector<char_type> _pbuf;
+    /** Read up to @p n characters from the file into @p buf. 
+	@return # of characters read. */
+    std::streamsize read_file(char_type* buf, std::streamsize n);
+    /** Write out the contents of the put area. 
+	@return false on failure. */
+    bool flush_put();
+    /** Apply the buffer size to zlib's own buffers. */
+    void set_zbuffer();
   protected:
     /** @name std::basic_streambuf interface. 
-	Forwards call to zlib gzFile abstraction layer. */ 
+	Buffered on top of the zlib gzFile abstraction layer. */ 
     /*@{*/
     /** write a character to output. 
 	@param c The character to write. 
 	@return EOF on failure or @p c on success. */
-    int_type overflow(int_type c=EOF) { return _file.overflow(c); }
-    /** Read the pending character from the stream and put it back. 
-	@return the next pending input. */
-    int_type underflow() { return _file.underflow(); }
-    /** Read the pending character from the stream. 
+    int_type overflow(int_type c=traits_type::eof());
+    /** Refill the get area. 
 	@return the next pending input. */
-    int_type uflow() { return _file.uflow(); }
-    /** Put back one character to the input stream. 
-	@param c the character to put back. 
-	@return EOF on failure, otherwise @p c */
-    int_type pbackfail(int_type c=EOF) { return _file.pbackfail(c); }
+    int_type underflow();
     /** Read a block of characters from the file. 
 	@param buf Buffer to read into. 
 	@param n Size of the buffer to fill. 
 	@return # of characters read. */
     std::streamsize xsgetn(char_type* buf, std::streamsize n);
-    /** Put back a block of characters to the file. 
+    /** Write a block of characters to the file. 
 	@param buf Buffer to read from. 
 	@param n Size of the buffer to write out. 
 	@return # of characters writen. */
-    std::streamsize xsputn(char_type* buf, std::streamsize n);
+    std::streamsize xsputn(const char_type* buf, std::streamsize n);
     /** Syncronise the stream. 
-	@return EOF on error. */
-    int sync() { return _file.sync(); }
+	@return -1 on error. */
+    int sync();
     /** Seek to an offset in the file in the stream. 
 	@param pos The position to seek to. 
 	@param dir The direction to seek in. 
@@ -114,24 +128,35 @@ namespace gzstream
 	@param pos The position to seek to. 
 	@param mode The open mode. 
 	@return new offset in the file. */
-    pos_type seekpos(off_type pos, 
+    pos_type seekpos(pos_type pos, 
 		     std::ios_base::openmode mode=
 		     std::ios::in|std::ios::out);
     
     /*@}*/
   public:
-    /** Constructor. */
-    basic_streambuf() : streambuf_type() { this->setbuf(0, 0); };
+    /** Constructor. 
+	@param bufsize Size of the I/O buffers, in characters. */
+    explicit basic_streambuf(std::size_t bufsize=default_bufsize) 
+      : streambuf_type(), _bufsize(bufsize ? bufsize : 1) 
+    { this->setg(0, 0, 0); this->setp(0, 0); }
     /** Constrcutor with an explicit zlib gzFile argument. 
 	This constructor is non-standard. 
-	@param fp A zlib gzFile pointer. */
-    basic_streambuf(gzFile fp) : streambuf_type(), _file(fp) { this->setbuf(0, 0); }
+	@param fp A zlib gzFile pointer. 
+	@param bufsize Size of the I/O buffers, in characters. */
+    basic_streambuf(gzFile fp, std::size_t bufsize=default_bufsize) 
+      : streambuf_type(), _file(fp), _bufsize(bufsize ? bufsize : 1) 
+    { this->setg(0, 0, 0); this->setp(0, 0); if (fp) set_zbuffer(); }
     /** Constrcutor with a gzipped filename argument. 
 	This constructor is non-standard. 
-	@param fn A zlib gzipped file filename. */
-    basic_streambuf(const char *fn, std::ios_base::openmode mode) : streambuf_type(), _file(0) { this->setbuf(0, 0); open(fn, mode); }
+	@param fn A zlib gzipped file filename. 
+	@param mode the mode to open the file in. 
+	@param bufsize Size of the I/O buffers, in characters. */
+    basic_streambuf(const char *fn, std::ios_base::openmode mode, 
+		    std::size_t bufsize=default_bufsize) 
+      : streambuf_type(), _file(0), _bufsize(bufsize ? bufsize : 1) 
+    { this->setg(0, 0, 0); this->setp(0, 0); open(fn, mode); }
     /** Destructor. */
-    virtual ~basic_streambuf() {}
+    virtual ~basic_streambuf() { flush_put(); }
     /** @name std::basic_filebuf interface. 
 	Forwards call to zlib gzFile abstraction layer. */ 
     /*@{*/
@@ -147,46 +172,212 @@ namespace gzstream
 	@return true if open, false otherwise. */
     bool is_open() const { return _file.is_open(); }
     /*@}*/
+    /** Size of the I/O buffers, in characters. */
+    std::size_t bufsize() const { return _bufsize; }
     /** Conversion operator. 
 	@return self as a pointer to zlib @c gzFile object. */
     operator gzFile () { return _file._file; }
   };
 
+  //__________________________________________________________________
+  template<typename T>
+  void
+  basic_streambuf<T>::set_zbuffer()
+  {
+    // zlib's input buffer holds compressed data, so it need not be
+    // larger than ours; it is clamped to [8k, 16M].
+    std::size_t z = _bufsize * sizeof(char_type);
+    if (z < 8192)     z = 8192;
+    if (z > 1 << 24)  z = 1 << 24;
+    _file.buffer(z);
+  }
+
   //__________________________________________________________________
   template<typename T>
   std::streamsize 
-  basic_streambuf<T>::xsgetn(basic_streambuf<T>::char_type* buf, 
+  basic_streambuf<T>::read_file(typename basic_streambuf<T>::char_type* buf, 
+				std::streamsize n)
+  {
+    // gzread takes an unsigned length; go in 1G chunks
+    const std::streamsize chunk = (1 << 30) / sizeof(char_type);
+    std::streamsize done = 0;
+    while (done < n) {
+      std::streamsize want = n - done < chunk ? n - done : chunk;
+      std::streamsize got  = _file.xsgetn(buf + done, want);
+      if (got <= 0) break;
+      done += got / sizeof(char_type);
+      if (got < std::streamsize(want * sizeof(char_type))) break;
+    }
+    return done;
+  }
+
+  //__________________________________________________________________
+  template<typename T>
+  bool
+  basic_streambuf<T>::flush_put()
+  {
+    std::streamsize n = this->pptr() - this->pbase();
+    if (n == 0) return true;
+    this->setp(this->pbase(), this->epptr());
+    return _file.xsputn(this->pbase(), n) == std::streamsize(n * sizeof(char_type));
+  }
+
+  //__________________________________________________________________
+  template<typename T>
+  typename basic_streambuf<T>::int_type
+  basic_streambuf<T>::overflow(typename basic_streambuf<T>::int_type c)
+  {
+    if (!is_open()) return traits_type::eof();
+    if (_pbuf.empty()) {
+      _pbuf.resize(_bufsize);
+      this->setp(&_pbuf[0], &_pbuf[0] + _pbuf.size());
+    }
+    else if (!flush_put()) 
+      return traits_type::eof();
+
+    if (traits_type::eq_int_type(c, traits_type::eof())) 
+      return traits_type::not_eof(c);
+    *this->pptr() = traits_type::to_char_type(c);
+    this->pbump(1);
+    return c;
+  }
+
+  //__________________________________________________________________
+  template<typename T>
+  typename basic_streambuf<T>::int_type
+  basic_streambuf<T>::underflow()
+  {
+    if (this->gptr() < this->egptr()) 
+      return traits_type::to_int_type(*this->gptr());
+    if (!is_open()) return traits_type::eof();
+
+    // keep the last character around, for putback
+    if (_gbuf.empty()) _gbuf.resize(_bufsize + 1);
+    std::size_t pb = 0;
+    if (this->gptr() != 0 && this->gptr() > this->eback()) {
+      _gbuf[0] = this->gptr()[-1];
+      pb = 1;
+    }
+
+    std::streamsize n = read_file(&_gbuf[1], _bufsize);
+    this->setg(&_gbuf[1] - pb, &_gbuf[1], &_gbuf[1] + n);
+    return n ? traits_type::to_int_type(*this->gptr()) : traits_type::eof();
+  }
+
+  //__________________________________________________________________
+  template<typename T>
+  std::streamsize 
+  basic_streambuf<T>::xsgetn(typename basic_streambuf<T>::char_type* buf, 
 			      std::streamsize n)
   {
-    return _file.xsgetn(buf, n);
+    std::streamsize done = 0;
+    while (done < n) {
+      // serve what we can from the get area
+      std::streamsize avail = this->egptr() - this->gptr();
+      if (avail) {
+	std::streamsize m = avail < n - done ? avail : n - done;
+	traits_type::copy(buf + done, this->gptr(), m);
+	this->setg(this->eback(), this->gptr() + m, this->egptr());
+	done += m;
+	continue;
+      }
+
+      // large requests are inflated straight into the caller's buffer
+      if (n - done >= std::streamsize(_bufsize)) {
+	if (!is_open()) break;
+	std::streamsize got = read_file(buf + done, n - done);
+	done += got;
+	if (got) {
+	  if (_gbuf.empty()) _gbuf.resize(_bufsize + 1);
+	  _gbuf[0] = buf[done - 1];
+	  this->setg(&_gbuf[0], &_gbuf[1], &_gbuf[1]);
+	}
+	break;
+      }
+
+      if (traits_type::eq_int_type(underflow(), traits_type::eof())) break;
+    }
+    return done;
   }
 
   //__________________________________________________________________
   template <typename T>
   std::streamsize 
-  basic_streambuf<T>::xsputn(basic_streambuf<T>::char_type* buf, 
-			   std::streamsize n)
+  basic_streambuf<T>::xsputn(const typename basic_streambuf<T>::char_type* buf, 
+			      std::streamsize n)
   {
-    return _file.xsgetn(buf, n);
+    if (!is_open()) return 0;
+
+    // small writes are collected in the put area
+    if (n < std::streamsize(_bufsize)) {
+      std::streamsize done = 0;
+      while (done < n) {
+	std::streamsize room = this->epptr() - this->pptr();
+	if (room == 0) {
+	  if (traits_type::eq_int_type(overflow(), traits_type::eof())) break;
+	  continue;
+	}
+	std::streamsize m = room < n - done ? room : n - done;
+	traits_type::copy(this->pptr(), buf + done, m);
+	this->pbump(m);
+	done += m;
+      }
+      return done;
+    }
+
+    // large ones are deflated directly from the caller's buffer
+    if (!flush_put()) return 0;
+    const std::streamsize chunk = (1 << 30) / sizeof(char_type);
+    std::streamsize done = 0;
+    while (done < n) {
+      std::streamsize want = n - done < chunk ? n - done : chunk;
+      std::streamsize put  = _file.xsputn(buf + done, want);
+      if (put <= 0) break;
+      done += put / sizeof(char_type);
+    }
+    return done;
+  }
+
+  //__________________________________________________________________
+  template <typename T>
+  int
+  basic_streambuf<T>::sync()
+  {
+    if (!is_open()) return -1;
+    if (_pbuf.empty()) return 0; // nothing was ever written
+    if (!flush_put()) return -1;
+    return _file.sync() == Z_OK ? 0 : -1;
   }
 
   //__________________________________________________________________
   template <typename T>
   typename basic_streambuf<T>::pos_type 
-  basic_streambuf<T>::seekoff(basic_streambuf<T>::off_type pos, 
+  basic_streambuf<T>::seekoff(typename basic_streambuf<T>::off_type pos, 
 			       std::ios_base::seekdir dir,
 			       std::ios_base::openmode mode) 
   {
+    if (!is_open()) return pos_type(off_type(-1));
+    std::streamsize unread = this->egptr() - this->gptr();
+
+    // tell: no need to throw away the buffers
+    if (dir == std::ios::cur && pos == 0) {
+      if (!flush_put()) return pos_type(off_type(-1));
+      return _file.seekoff(0, dir, mode) - off_type(unread);
+    }
+
+    if (!flush_put()) return pos_type(off_type(-1));
+    if (dir == std::ios::cur) pos -= unread;
+    this->setg(0, 0, 0);
     return _file.seekoff(pos, dir, mode);
   }
   
   //__________________________________________________________________
   template <typename T>
   typename basic_streambuf<T>::pos_type 
-  basic_streambuf<T>::seekpos(basic_streambuf<T>::off_type pos, 
+  basic_streambuf<T>::seekpos(typename basic_streambuf<T>::pos_type pos, 
 			 std::ios_base::openmode mode) 
   {
-    return _file.seekpos(pos, mode);
+    return seekoff(off_type(pos), std::ios::beg, mode);
   }
   
 
@@ -196,7 +387,9 @@ namespace gzstream
   basic_streambuf<T>::open(const char* name, 
 			    std::ios_base::openmode mode) 
   {
-    return _file.open(name, mode) ? this : 0;
+    if (!_file.open(name, mode)) return 0;
+    set_zbuffer();
+    return this;
   }
   
   //__________________________________________________________________
@@ -204,7 +397,11 @@ namespace gzstream
   typename basic_streambuf<T>::streambuf_type*
   basic_streambuf<T>::close()
   {
-    return _file.close() ? this : 0; 
+    bool ok = flush_put();
+    this->setg(0, 0, 0);
+    this->setp(0, 0);
+    _pbuf.clear();
+    return _file.close() && ok ? this : 0; 
   }
   
   //==================================================================
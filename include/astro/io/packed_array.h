@@ -0,0 +1,212 @@
+#ifndef __astro_io_packed_array_h
+#define __astro_io_packed_array_h
+
+#include <astro/io/fpnumber.h>
+#include <astro/io/binarystream.h>
+#include <astro/exceptions.h>
+
+#include <boost/static_assert.hpp>
+
+#include <vector>
+#include <algorithm>
+
+namespace peyton {
+namespace io {
+
+/**
+	\brief Array of numbers in [0, 1), stored in an m+k bit floating point format
+
+	Values are packed with bitpack() (see fpnumber) into a contiguous
+	bitstream of (m + k)-bit fields, so that, for example, a column of
+	quantized 12 bit values takes 3/16ths of the space of the corresponding
+	array of doubles.
+
+	The bitstream is kept in 64-bit words (in native byte order), value i
+	occupying bits [i*(m+k), (i+1)*(m+k)) counting from the least significant
+	bit of the first word. The storage is either owned by the array, or is
+	an external buffer of words(n) words, such as a memory mapped file:
+
+	\code
+	typedef packed_array<12, 2> column;
+
+	column mag(n);
+	mag.encode(&m[0], n);		// or mag.set(i, m[i]), value by value
+
+	std::ofstream f("mag.bin");
+	obstream out(f);
+	out << mag;
+
+	...
+
+	MemoryMap mm("mag.bin", sizeof(size_t) + column::bytes(n));
+	column view((char *)(void *)mm + sizeof(size_t), n);
+	double x = view[i];
+	\endcode
+
+	Individual values are unpacked on access; use decode() to efficiently
+	unpack whole ranges.
+*/
+template<int m, int k>
+class packed_array
+{
+public:
+	BOOST_STATIC_ASSERT(m >= 1 && k >= 0 && m + k <= 32);
+
+	enum { bits = m + k };
+	typedef unsigned long long word;
+
+	/// number of words needed to store n values
+	static size_t words(size_t n) { return (n * bits + 63) / 64; }
+	/// number of bytes needed to store n values
+	static size_t bytes(size_t n) { return words(n) * sizeof(word); }
+
+protected:
+	static const word mask = (1ULL << bits) - 1;
+
+	std::vector<word> store;	///< owned storage (empty for views)
+	word *w;			///< storage in use
+	size_t n;			///< number of values
+
+public:
+	packed_array() : w(NULL), n(0) {}
+	explicit packed_array(size_t n_) : store(words(n_) + 1), w(&store[0]), n(n_) {}
+
+	/// a view of \a n_ values stored in external memory \a mem, which must hold at least words(n_) words
+	packed_array(void *mem, size_t n_) : w((word *)mem), n(n_) {}
+
+	packed_array(const packed_array &a) : store(a.store), w(a.owns() ? &store[0] : a.w), n(a.n) {}
+	packed_array &operator=(const packed_array &a)
+	{
+		store = a.store;
+		w = a.owns() ? &store[0] : a.w;
+		n = a.n;
+		return *this;
+	}
+
+	size_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	/// true if the array owns its storage (as opposed to being a view of an external buffer)
+	bool owns() const { return !store.empty(); }
+
+	/// the underlying bitstream, bytes(size()) bytes long
+	word *data() { return w; }
+	const word *data() const { return w; }
+
+	/// resize the array, preserving the contents. Views cannot be resized.
+	void resize(size_t n_)
+	{
+		if(!owns() && n != 0) { THROW(peyton::exceptions::EAny, "Cannot resize a view of external storage"); }
+
+		// the extra word keeps the store non-empty (and thus, owned) even for n_ = 0
+		store.resize(words(n_) + 1);
+		w = &store[0];
+
+		// clear the tail, so that values beyond the old end read as zeros
+		if(n_ > n)
+		{
+			size_t b = n * bits;
+			if(b % 64) { w[b / 64] &= (1ULL << (b % 64)) - 1; }
+			for(size_t i = (b + 63) / 64; i != store.size(); i++) { w[i] = 0; }
+		}
+		n = n_;
+	}
+
+	/// packed representation of the i-th value
+	unsigned raw(size_t i) const
+	{
+		const size_t b = i * bits;
+		const unsigned s = b % 64;
+		word v = w[b / 64] >> s;
+		if(s + bits > 64) { v |= w[b / 64 + 1] << (64 - s); }
+		return (unsigned)(v & mask);
+	}
+
+	/// store the packed representation \a v of the i-th value
+	void set_raw(size_t i, unsigned v)
+	{
+		const size_t b = i * bits;
+		const unsigned s = b % 64;
+		word *p = w + b / 64;
+		p[0] = (p[0] & ~(mask << s)) | ((word)v << s);
+		if(s + bits > 64)
+		{
+			p[1] = (p[1] & ~(mask >> (64 - s))) | ((word)v >> (64 - s));
+		}
+	}
+
+	double operator[](size_t i) const { return bitunpack(m, k, raw(i)); }
+
+	/// set the i-th value to \a x. Returns a bitpack_status code.
+	int set(size_t i, double x)
+	{
+		unsigned v;
+		int ret = bitpack(m, k, &x, &v, 1);
+		if(ret == BP_OK) { set_raw(i, v); }
+		return ret;
+	}
+
+	/**
+		Pack \a cnt values from \a x into elements [at, at+cnt). Returns a
+		bitpack_status code; on error, values before the offending one
+		(whose index in \a x is stored into \a bad, if given) are stored.
+	*/
+	int encode(const double *x, size_t cnt, size_t at = 0, size_t *bad = NULL)
+	{
+		unsigned buf[256];
+		for(size_t i = 0; i < cnt; i += 256)
+		{
+			const size_t len = std::min<size_t>(256, cnt - i);
+			size_t b;
+			int ret = bitpack(m, k, x + i, buf, len, &b);
+			for(size_t j = 0; j != (ret == BP_OK ? len : b); j++) { set_raw(at + i + j, buf[j]); }
+			if(ret != BP_OK)
+			{
+				if(bad) { *bad = i + b; }
+				return ret;
+			}
+		}
+		return BP_OK;
+	}
+
+	/// Unpack elements [at, at+cnt) into \a x
+	void decode(double *x, size_t cnt, size_t at = 0) const
+	{
+		unsigned buf[256];
+		for(size_t i = 0; i < cnt; i += 256)
+		{
+			const size_t len = std::min<size_t>(256, cnt - i);
+			for(size_t j = 0; j != len; j++) { buf[j] = raw(at + i + j); }
+			bitunpack(m, k, buf, x + i, len);
+		}
+	}
+};
+
+template<int m, int k>
+const typename packed_array<m, k>::word packed_array<m, k>::mask;
+
+//
+// Binary I/O: the number of elements, followed by the bitstream
+//
+template<int m, int k>
+	inline BOSTREAM2(const packed_array<m, k> &a)
+	{
+		out << a.size();
+		return out.write_pod(a.data(), packed_array<m, k>::words(a.size()));
+	}
+
+template<int m, int k>
+	inline BISTREAM2(packed_array<m, k> &a)
+	{
+		size_t n;
+		if(!(in >> n)) { return in; }
+
+		a = packed_array<m, k>(n);
+		return in.read_pod(a.data(), packed_array<m, k>::words(n));
+	}
+
+} // namespace io
+} // namespace peyton
+
+#define __peyton_io peyton::io
+
+#endif
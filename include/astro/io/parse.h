@@ -0,0 +1,110 @@
+#ifndef __astro_io_parse_h
+#define __astro_io_parse_h
+
+#include <cstring>
+
+namespace peyton {
+namespace io {
+
+/**
+	\brief Fast, locale independent text to number conversion
+
+	These functions are the parsing counterpart of io::format, meant for
+	ingesting large fixed-width (eg. ASTORB) or whitespace delimited text
+	tables. Unlike atof() and sscanf(), they work on character ranges
+	which need not be NUL-terminated, never depend on the current locale
+	(the decimal point is always '.'), and avoid most of the per-call
+	overhead of the C library.
+
+	Doubles are converted exactly (correctly rounded, as by strtod()).
+	Numbers with up to 15 significant digits and a modest exponent, which
+	is to say nearly every number in a catalog, are converted with a
+	single floating point multiplication or division; the rest are handed
+	to the C library. Runs of eight digits are converted at once with
+	64-bit integer arithmetic.
+
+	\code
+	const char *rec = ...;	// a fixed-width record
+
+	double h = parse::atof(rec + 41, rec + 46);
+	int year;
+	if(!parse::field(rec + 105, 4, year)) { ... }
+
+	const char *p = line, *end = line + strlen(line);
+	double ra, dec;
+	if(!parse::next(p, end, ra) || !parse::next(p, end, dec)) { ... }
+	\endcode
+*/
+namespace parse {
+
+	/**
+		Parse the number at the beginning of [p, end), skipping any leading
+		blanks. Returns a pointer one past the last character of the number,
+		or NULL (leaving \a x unmodified) if there is no number there.
+
+		Floating point numbers have the usual [+-]ddd.ddd[(e|E)[+-]ddd]
+		syntax, or are one of inf, infinity or nan. Integers are decimal,
+		with an optional sign; out of range values are an error.
+	*/
+	const char *number(const char *p, const char *end, double &x);
+	const char *number(const char *p, const char *end, float &x);
+	const char *number(const char *p, const char *end, long long &x);
+	const char *number(const char *p, const char *end, int &x);
+
+	/// true if [p, end) contains nothing but blanks
+	inline bool blank(const char *p, const char *end)
+	{
+		while(p != end && (*p == ' ' || *p == '\t')) { ++p; }
+		return p == end;
+	}
+
+	/**
+		Parse a fixed-width field [p, p + width). Blanks on either side of the
+		number are ignored, but anything else invalidates the field. Returns
+		false (leaving \a x unmodified) for invalid or blank fields.
+	*/
+	template<typename T>
+	inline bool field(const char *p, int width, T &x)
+	{
+		const char *end = p + width;
+		T tmp;
+		const char *q = number(p, end, tmp);
+		if(q == NULL || !blank(q, end)) { return false; }
+		x = tmp;
+		return true;
+	}
+
+	/**
+		Parse the next whitespace delimited field of [p, end), advancing \a p
+		past it. Returns false if the field is missing or is not a number.
+	*/
+	template<typename T>
+	inline bool next(const char *&p, const char *end, T &x)
+	{
+		const char *q = number(p, end, x);
+		if(q == NULL) { return false; }
+		if(q != end && !(*q == ' ' || *q == '\t' || *q == '\n' || *q == '\r')) { return false; }
+		p = q;
+		return true;
+	}
+
+	/**
+		Equivalents of the C library atof(), atoi() and atoll(): parse as much
+		of [p, end) as forms a number, returning 0 if there is none.
+	*/
+	inline double atof(const char *p, const char *end)	{ double x = 0; number(p, end, x); return x; }
+	inline int atoi(const char *p, const char *end)		{ int x = 0; number(p, end, x); return x; }
+	inline long long atoll(const char *p, const char *end)	{ long long x = 0; number(p, end, x); return x; }
+
+	inline double atof(const char *s)			{ return atof(s, s + strlen(s)); }
+	inline int atoi(const char *s)				{ return atoi(s, s + strlen(s)); }
+	inline long long atoll(const char *s)			{ return atoll(s, s + strlen(s)); }
+
+} // namespace parse
+
+} // namespace io
+} // namespace peyton
+
+#define __peyton_io peyton::io
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef __astro_io_table_h
+#define __astro_io_table_h
+
+#include <astro/io/format.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace peyton {
+namespace io {
+
+/**
+	\brief Fast writer of large text tables
+
+	The table layout is given once, as a format string for a single row,
+	using the same syntax (and producing byte-identical output) as
+	io::format. Rows are formatted through a compiled_format into a large
+	in-memory buffer, which is written to the output stream in one call
+	whenever it fills up.
+
+	Rows can be output one at a time:
+
+	\code
+	io::table_writer tab(out, "%6d %12.8f %12.8f %s\n");
+	for(int i = 0; i != n; i++)
+	{
+		tab.row() << id[i] << ra[i] << dec[i] << name[i];
+	}
+	tab.flush();
+	\endcode
+
+	or from arrays holding whole columns, in which case the formatting of
+	consecutive chunks of rows is spread over multiple threads:
+
+	\code
+	io::table_writer tab(out, "%6d %12.8f %12.8f %s\n", 0);	// 0 = one thread per core
+	tab.column(id).column(ra).column(dec).column(name);
+	tab.write(n);
+	\endcode
+
+	Columns may be arrays of any type with an io::format operator<<
+	(numbers, strings, char pointers, or user types with a format_type()
+	specialization). They are bound in the order of the conversions in
+	the row format.
+*/
+class table_writer
+{
+protected:
+	/// a bound column array
+	struct column_base
+	{
+		virtual void format(compiled_formatter &f, size_t row) const = 0;
+		virtual ~column_base() {}
+	};
+
+	template<typename T>
+	struct column_t : public column_base
+	{
+		const T *data;
+		column_t(const T *d) : data(d) {}
+		virtual void format(compiled_formatter &f, size_t row) const { f << data[row]; }
+	};
+
+	std::ostream &out;
+	compiled_format fmt;
+	std::vector<column_base *> columns;
+
+	std::string buf;		///< formatted, but not yet written, output
+	size_t bufsize;			///< flush once the buffer grows beyond this size
+	int nthreads;
+	size_t chunk;			///< rows per parallel formatting job
+
+	void format_rows(size_t from, size_t to, std::string *dest) const;
+
+private:
+	table_writer(const table_writer &);
+	table_writer &operator=(const table_writer &);
+
+public:
+	/**
+		Write to \a out, with a row format \a rowfmt. Bulk writes are
+		formatted on \a nthreads threads (<= 0 for one per core).
+	*/
+	table_writer(std::ostream &out, const std::string &rowfmt, int nthreads = 1, size_t bufsize = 1 << 20);
+	~table_writer();
+
+	/// Begin a new row. Stream the values of its columns into the returned object.
+	compiled_formatter row()
+	{
+		if(buf.size() >= bufsize) { flush(); }
+		return fmt.into(buf);
+	}
+
+	/// Bind the next column to array \a data
+	template<typename T>
+	table_writer &column(const T *data)
+	{
+		columns.push_back(new column_t<T>(data));
+		return *this;
+	}
+	template<typename T>
+	table_writer &column(const std::vector<T> &data) { return column(data.empty() ? NULL : &data[0]); }
+
+	/// Unbind all columns
+	void clear_columns();
+
+	/// Format and write rows [from, to) of the bound columns
+	void write(size_t from, size_t to);
+	/// Format and write the first \a nrows rows of the bound columns
+	void write(size_t nrows) { write(0, nrows); }
+
+	/// Write out any buffered rows
+	void flush();
+};
+
+} // namespace io
+} // namespace peyton
+
+#define __peyton_io peyton::io
+
+#endif
@@ -9,6 +9,7 @@
 #include <cstdlib>
 
 #include "astro/util.h"
+#include "astro/io/parse.h"
 
 namespace peyton {
 namespace system {
@@ -45,14 +46,26 @@ var4 = To expand a key with spaces, enclose it in curly braces, eg ${key with sp
 	protected:
 		class Variant : public std::string
 		{
+		protected:
+			// Values are parsed as by atof() (so integers may use exponential
+			// notation too), with io::parse for speed. Values the fast parser
+			// does not read in full (eg. hex, "0x10") are left to strtod().
+			double number() const
+			{
+				const char *s = c_str(), *end = s + size();
+				double x = 0;
+				const char *p = io::parse::number(s, end, x);
+				if(p == NULL || !io::parse::blank(p, end)) { return strtod(s, NULL); }
+				return x;
+			}
 		public:
-			long long vlonglong() const 		{ return (long long)		atof(c_str()); } // Note: I use atof() to allow exponential notation for integers
-			int vint() const 			{ return (int)			atof(c_str()); } // Note: I use atof() to allow exponential notation for integers
-			unsigned vunsigned() const 		{ return (unsigned)		atof(c_str()); } // Note: I use atof() to allow exponential notation for integers
-			unsigned long vulong() const 		{ return (unsigned long)	atof(c_str()); } // Note: I use atof() to allow exponential notation for integers
-			unsigned long long vullong() const 	{ return (unsigned long long)	atof(c_str()); } // Note: I use atof() to allow exponential notation for integers
-			double vdouble() const 			{ return atof(c_str()); }
-			float vfloat() const 			{ return atof(c_str()); }
+			long long vlonglong() const 		{ return (long long)		number(); }
+			int vint() const 			{ return (int)			number(); }
+			unsigned vunsigned() const 		{ return (unsigned)		number(); }
+			unsigned long vulong() const 		{ return (unsigned long)	number(); }
+			unsigned long long vullong() const 	{ return (unsigned long long)	number(); }
+			double vdouble() const 			{ return number(); }
+			float vfloat() const 			{ return number(); }
 			bool vbool() const {
 				if(*this == "true") return true;
 				if(*this == "false") return false;
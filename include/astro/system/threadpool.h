@@ -0,0 +1,74 @@
+#ifndef __astro_system_threadpool_h
+#define __astro_system_threadpool_h
+
+#include <astro/exceptions.h>
+
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <deque>
+#include <string>
+
+namespace peyton {
+
+namespace exceptions {
+	SIMPLE_EXCEPTION(EThreadPool);
+}
+
+namespace system {
+
+/**
+	\brief A fixed-size pool of worker threads executing queued jobs
+
+	Jobs are arbitrary nullary callables (usually built with boost::bind),
+	executed in FIFO order by the first available worker. A job that throws
+	does not bring down the pool; the error is recorded and rethrown as
+	EThreadPool from the next call to wait().
+
+	\code
+	ThreadPool pool;		// one thread per core
+	for(int i = 0; i != n; i++) { pool.submit(boost::bind(work, i)); }
+	pool.wait();			// block until all jobs have finished
+	\endcode
+*/
+class ThreadPool
+{
+public:
+	typedef boost::function<void ()> job_t;
+protected:
+	boost::thread_group workers;
+	std::deque<job_t> jobs;
+
+	boost::mutex lock;
+	boost::condition_variable haswork;	// signalled when a job is queued (or on shutdown)
+	boost::condition_variable idle;		// signalled when a job completes
+
+	int running;		// number of jobs currently executing
+	bool stopping;
+	std::string error;	// error message of the first failed job, if any
+
+	void worker();
+public:
+	/// number of hardware threads (at least 1)
+	static int hardware_concurrency();
+
+	/// Start \a nthreads workers. If \a nthreads <= 0, start one per core.
+	explicit ThreadPool(int nthreads = 0);
+	~ThreadPool();
+
+	/// queue a job for execution
+	void submit(const job_t &job);
+	/// block until the queue is empty and all workers are idle
+	void wait() throw(peyton::exceptions::EThreadPool);
+	/// number of worker threads
+	int size() const { return workers.size(); }
+};
+
+} // namespace system
+} // namespace peyton
+
+#define __peyton_system peyton::system
+
+#endif
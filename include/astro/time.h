@@ -3,6 +3,10 @@
 
 #include <astro/types.h>
 
+#include <string>
+#include <vector>
+#include <cstddef>
+
 namespace peyton {
 /// time and date related functions and classes
 namespace time {
@@ -13,6 +17,21 @@ namespace time {
 	double dayfrac(int h, int m, int s);
 
 	char *toMPECTimeFormat(char *str, peyton::MJD time);
+
+	/**
+		\name Array versions
+
+		Convert n dates at a time, with results identical to those of the
+		scalar functions. Dates in the years 1583 to 9999 (Gregorian
+		calendar) are converted by table lookup or branch-free integer
+		arithmetic; the rest are handed to the scalar functions.
+	*/
+	//@{
+	void MJD2cal(const double *mjd, int *year, int *month, double *dd, size_t n);
+	void calToJD(const int *y, const int *m, const int *d, const double *h, double *jd, size_t n);
+	void calToMJD(const int *y, const int *m, const int *d, const double *h, double *mjd, size_t n);
+	void toMPECTimeFormat(const peyton::MJD *time, size_t n, std::vector<std::string> &out);
+	//@}
 }
 namespace Time = time;
 }
@@ -2,12 +2,18 @@
 
 #include <astro/coordinates.h>
 #include <astro/constants.h>
+#include <astro/io/parse.h>
+#include <astro/io/format.h>
 
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <limits>
+
 using namespace peyton;
+using namespace peyton::coordinates;
 
 /*
 ################################################################
@@ -215,6 +221,7 @@ coordinates::equgal(Radians ra, Radians dec, Radians &l, Radians &b)
 	b = asin(sb);
 
 	while(l < 0) { l += ctn::pi2; }
+	while(l >= ctn::pi2) { l -= ctn::pi2; }
 }
 
 void // equgal - Equatorial to Galactic coordinates
@@ -232,6 +239,7 @@ coordinates::galequ(Radians l, Radians b, Radians &ra, Radians &dec)
 	dec = asin(cb*ce*sl + sb*se);
 
 	while(ra < 0) { ra += ctn::pi2; }
+	while(ra >= ctn::pi2) { ra -= ctn::pi2; }
 }
 
 void // gcsgal - SDSS GCS to Galactic coordinates
@@ -382,6 +390,152 @@ void coordinates::formatCoord(const char *fmt, char *out, const double _v)
 		);
 }
 
+//
+// Fast formatting of coordinates
+//
+
+namespace {
+
+	inline bool digit(char c) { return '0' <= c && c <= '9'; }
+
+	/// a literal piece of text, or a conversion of a value in the format
+	struct field
+	{
+		enum { LITERAL = -1, SIGN = -2 };
+		int what;		///< LITERAL, SIGN, or the index of the value to convert
+		std::string text;	///< literal text, or the printf conversion (eg. "%05.2f")
+
+		io::trad_format tf;	///< parsed conversion
+		bool fast;		///< if the conversion can be done by io::append_double
+
+		field(int what_, const std::string &text_);
+		/// append \a v, formatted as printf would with conversion \a text
+		void append(std::string &out, double v) const;
+	};
+
+	// conversions of formatCoord(char *ras, char *decs, ...)
+	const field f02_0(0, "%02.0f"), f04_1(0, "%04.1f"), f05_2(0, "%05.2f");
+
+}
+
+struct CoordFormat::impl
+{
+	std::vector<field> fields;
+};
+
+field::field(int what_, const std::string &text_)
+	: what(what_), text(text_), fast(false)
+{
+	if(what < 0) { return; }
+
+	// parse "%[-+ 0]?[0-9]*(.[0-9]*)?f"; anything else is left to sprintf
+	const char *c = text.c_str() + 1;
+	tf.flag = *c && strchr("-+ 0", *c) ? *c++ : 0;
+	const bool flags = *c && strchr("-+ 0", *c);
+	tf.width = -1;
+	if(digit(*c)) { for(tf.width = 0; digit(*c); c++) { tf.width = 10*tf.width + (*c - '0'); } }
+	tf.prec = -1;
+	if(*c == '.') { for(tf.prec = 0, c++; digit(*c); c++) { tf.prec = 10*tf.prec + (*c - '0'); } }
+	tf.length[0] = 0;
+	tf.conversion = 'f';
+	fast = !flags && c[0] == 'f' && c[1] == 0;
+}
+
+void field::append(std::string &out, double v) const
+{
+	if(fast) { io::append_double(out, v, tf); return; }
+
+	char buf[512];
+	const int n = snprintf(buf, sizeof(buf), text.c_str(), v);
+	out.append(buf, std::min(sizeof(buf) - 1, (size_t)std::max(n, 0)));
+}
+
+CoordFormat::CoordFormat(const std::string &fmt_)
+{
+	impl *fi = new impl;
+	p.reset(fi);
+	std::vector<field> &fields = fi->fields;
+
+	// parsed the same way as in formatCoord(fmt, out, v)
+	const char *valid = "HMSINdmsing";
+	const char *c = fmt_.c_str();
+	std::string lit;
+	int id;
+
+	while(*c != 0) {
+		if(*c == '%') {
+			const char *start = c;
+			while(*c != 0 && (id = str_find(valid, *c)) == -1) {
+				c++;
+			}
+			if(*c == 0) break;
+
+			if(!lit.empty()) { fields.push_back(field(field::LITERAL, lit)); lit.clear(); }
+			if(*c == 'g') {
+				fields.push_back(field(field::SIGN, ""));
+			} else {
+				fields.push_back(field(id, std::string(start, c) + 'f'));
+			}
+		} else {
+			lit += *c;
+		}
+		c++;
+	}
+	if(!lit.empty()) { fields.push_back(field(field::LITERAL, lit)); }
+}
+
+void CoordFormat::append(std::string &out, const double _v) const
+{
+	double v;
+	double H, M, S;
+	v = _v;
+	H = v / 15; v -= int(H) * 15;
+	M = v * 4; v -= floor(M) / 4;
+	S = v * 240;
+
+	v = fabs(_v);
+	double d, m, s;
+	d = v; v -= floor(d);
+	m = v * 60; v -= floor(m) / 60;
+	s = v * 3600;
+
+	const double asrc[] = {floor(H), floor(M), S, H, M, floor(d), floor(m), s, d, m};
+
+	const std::vector<field> &fields = p->fields;
+	for(size_t i = 0; i != fields.size(); i++)
+	{
+		const field &f = fields[i];
+		switch(f.what)
+		{
+		case field::LITERAL:
+			out += f.text;
+			break;
+		case field::SIGN:
+			out += _v > 0 ? '+' : '-';
+			break;
+		default:
+			f.append(out, asrc[f.what]);
+		}
+	}
+}
+
+void CoordFormat::operator()(char *out, const double v) const
+{
+	std::string s;
+	append(s, v);
+	strcpy(out, s.c_str());
+}
+
+void CoordFormat::operator()(const double *v, size_t n, std::vector<std::string> &out) const
+{
+	out.resize(n);
+	for(size_t i = 0; i != n; i++)
+	{
+		out[i].clear();
+		append(out[i], v[i]);
+	}
+}
+
 void coordinates::formatCoord(char *ras, char *decs, const double ra_, const double dec_, const int fmt)
 {
 	double ra = ra_, dec = dec_;
@@ -393,12 +547,12 @@ void coordinates::formatCoord(char *ras, char *decs, const double ra_, const dou
 	a = int(ra / 15); ra -= a * 15;
 	b = int(ra * 4); ra -= (float)b / 4;
 	c = ra * 240;
-	if(fmt & FC_MPEC_FORMAT)
-		sprintf(ras, "%02.0f %02.0f %05.2f", (float)a, (float)b, c);
-	else if(fmt & FC_NO_FRAC_SECONDS)
-		sprintf(ras, "%02.0f:%02.0f:%02.0f", (float)a, (float)b, c);
-	else
-		sprintf(ras, "%02.0f:%02.0f:%05.2f", (float)a, (float)b, c);
+	const char sep = fmt & FC_MPEC_FORMAT ? ' ' : ':';
+	std::string out;
+	f02_0.append(out, (float)a); out += sep;
+	f02_0.append(out, (float)b); out += sep;
+	((fmt & (FC_MPEC_FORMAT | FC_NO_FRAC_SECONDS)) == FC_NO_FRAC_SECONDS ? f02_0 : f05_2).append(out, c);
+	strcpy(ras, out.c_str());
 
 	a = int(dec); dec -= a; dec = fabs(dec);
 	b = int(dec * 60); dec -= (float)b / 60;
@@ -420,12 +574,114 @@ void coordinates::formatCoord(char *ras, char *decs, const double ra_, const dou
 	b = (int)fabs(b);
 	c = fabs(c);
 
+	out = neg;
+	f02_0.append(out, (float)a); out += sep;
+	f02_0.append(out, (float)b); out += sep;
 	if(fmt & FC_MPEC_FORMAT)
-		sprintf(decs, "%c%02.0f %02.0f %04.1f", neg, (float)a, (float)b, c);
+		f04_1.append(out, c);
 	else if(fmt & FC_NO_FRAC_SECONDS)
-		sprintf(decs, "%c%02.0f:%02.0f:%02.0f", neg, (float)a, (float)b, c);
+		f02_0.append(out, c);
 	else
-		sprintf(decs, "%c%02.0f:%02.0f:%05.2f", neg, (float)a, (float)b, c);
+		f05_2.append(out, c);
+	strcpy(decs, out.c_str());
+
+}
 
+
+void coordinates::formatCoord(const double *ra, const double *dec, size_t n, std::vector<std::string> &ras, std::vector<std::string> &decs, const int fmt)
+{
+	char rbuf[128], dbuf[128];
+	ras.resize(n);
+	decs.resize(n);
+	for(size_t i = 0; i != n; i++)
+	{
+		formatCoord(rbuf, dbuf, ra[i], dec[i], fmt);
+		ras[i] = rbuf;
+		decs[i] = dbuf;
+	}
 }
 
+//
+// Parsing of sexagesimal coordinates
+//
+
+const char *coordinates::parseSexagesimal(const char *s, double &v)
+{
+	const char *end = s + strlen(s);
+	while(*s == ' ' || *s == '\t') { s++; }
+
+	double sign = 1.;
+	if(*s == '+' || *s == '-') { sign = *s == '-' ? -1. : 1.; s++; }
+	if(!digit(*s)) { return NULL; }
+
+	double part[3] = { 0., 0., 0. };
+	for(int k = 0; k != 3; k++)
+	{
+		if(k)
+		{
+			const char *t = s;
+			while(*t == ' ' || *t == ':') { t++; }
+			if(t == s || !digit(*t)) { break; }
+			s = t;
+		}
+
+		// the component with a fractional part is the last one
+		const char *start = s;
+		if((s = io::parse::number(s, end, part[k])) == NULL) { return NULL; }
+		if(std::find(start, s, '.') != s) { break; }
+	}
+
+	v = sign * (part[0] + part[1] / 60. + part[2] / 3600.);
+	return s;
+}
+
+namespace {
+
+	// parse a string holding a single value
+	inline bool parse_whole(const char *s, double &v)
+	{
+		const char *e = parseSexagesimal(s, v);
+		if(e == NULL) { return false; }
+		while(*e == ' ' || *e == '\t' || *e == '\n' || *e == '\r') { e++; }
+		return *e == 0;
+	}
+
+	const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+}
+
+size_t coordinates::parseSexagesimal(const std::vector<std::string> &s, double *v)
+{
+	size_t k = 0;
+	for(size_t i = 0; i != s.size(); i++)
+	{
+		if(parse_whole(s[i].c_str(), v[i])) { k++; } else { v[i] = NaN; }
+	}
+	return k;
+}
+
+bool coordinates::parseCoord(const char *ras, const char *decs, double &ra, double &dec)
+{
+	if(!parse_whole(ras, ra) || !parse_whole(decs, dec)) { return false; }
+	ra *= 15.;
+	return true;
+}
+
+size_t coordinates::parseCoord(const std::vector<std::string> &ras, const std::vector<std::string> &decs, double *ra, double *dec)
+{
+	size_t k = 0;
+	for(size_t i = 0; i != ras.size(); i++)
+	{
+		if(parseCoord(ras[i].c_str(), decs[i].c_str(), ra[i], dec[i])) { k++; } else { ra[i] = dec[i] = NaN; }
+	}
+	return k;
+}
+
+const char *coordinates::parseRaDec(const char *line, double &ra, double &dec)
+{
+	const char *s = parseSexagesimal(line, ra);
+	if(s == NULL || !(*s == ' ' || *s == '\t')) { return NULL; }
+	if((s = parseSexagesimal(s, dec)) == NULL) { return NULL; }
+	ra *= 15.;
+	return s;
+}
@@ -0,0 +1,327 @@
+//
+// Angular cross-matching, with a k-d tree over unit vectors.
+//
+// The tree is implicit: node [lo, hi) is split at its median point,
+// mid = lo + (hi - lo)/2, along the dimension of the largest extent of its
+// points (stored in dim[mid]), with the points of the left subtree in
+// [lo, mid) and of the right one in [mid+1, hi). Ranges of up to LEAF
+// points are leaves, and are scanned linearly.
+//
+
+#include <astro/crossmatch.h>
+#include <astro/coordinates.h>
+#include <astro/system/threadpool.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace peyton;
+using namespace peyton::coordinates;
+using peyton::math::V3;
+
+typedef CrossMatch::Match Match;
+
+namespace {
+
+	const size_t LEAF = 8;
+	const size_t npos = (size_t)-1;
+
+	struct by_dim
+	{
+		int d;
+		by_dim(int d_) : d(d_) {}
+		template<typename T> bool operator()(const T &a, const T &b) const { return a.v[d] < b.v[d]; }
+	};
+
+	inline double dist2(const V3 &a, const V3 &b)
+	{
+		const double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+		return dx*dx + dy*dy + dz*dz;
+	}
+
+	// chord length squared <-> angle
+	inline double chord2(Radians r) { if(r >= ctn::pi) { return 4.; } const double c = 2*sin(0.5*r); return c*c; }
+	inline Radians chord2angle(double c2) { return 2*asin(std::min(1., 0.5*std::sqrt(c2))); }
+
+	void append_vector(std::vector<Match> *out, const std::vector<Match> &m)
+	{
+		out->insert(out->end(), m.begin(), m.end());
+	}
+
+	void append_dmm(system::DMMArray<Match> *out, const std::vector<Match> &m)
+	{
+		for(size_t i = 0; i != m.size(); i++) { out->push_back(m[i]); }
+	}
+
+} // namespace
+
+CrossMatch::CrossMatch(const V3 *v, size_t n, int nthreads_)
+	: pts(n), nthreads(nthreads_ > 0 ? nthreads_ : system::ThreadPool::hardware_concurrency()), chunk(16384)
+{
+	for(size_t i = 0; i != n; i++)
+	{
+		pts[i].v = v[i] / abs(v[i]);
+		pts[i].i = i;
+	}
+	build_tree();
+}
+
+CrossMatch::CrossMatch(const double *lon, const double *lat, size_t n, int nthreads_)
+	: pts(n), nthreads(nthreads_ > 0 ? nthreads_ : system::ThreadPool::hardware_concurrency()), chunk(16384)
+{
+	for(size_t i = 0; i != n; i++)
+	{
+		pts[i].v = unitvec(lon[i], lat[i]);
+		pts[i].i = i;
+	}
+	build_tree();
+}
+
+//
+// Split node [lo, hi) at its median, returning the index of the median
+//
+size_t CrossMatch::split(size_t lo, size_t hi)
+{
+	V3 vmin(pts[lo].v), vmax(pts[lo].v);
+	for(size_t i = lo + 1; i != hi; i++)
+	{
+		for(int d = 0; d != 3; d++)
+		{
+			vmin[d] = std::min(vmin[d], pts[i].v[d]);
+			vmax[d] = std::max(vmax[d], pts[i].v[d]);
+		}
+	}
+	const V3 ext = vmax - vmin;
+	const int d = ext.x >= ext.y ? (ext.x >= ext.z ? 0 : 2) : (ext.y >= ext.z ? 1 : 2);
+
+	const size_t mid = lo + (hi - lo)/2;
+	std::nth_element(pts.begin() + lo, pts.begin() + mid, pts.begin() + hi, by_dim(d));
+	dim[mid] = d;
+
+	return mid;
+}
+
+void CrossMatch::build(size_t lo, size_t hi)
+{
+	if(hi - lo <= LEAF) { return; }
+
+	const size_t mid = split(lo, hi);
+	build(lo, mid);
+	build(mid + 1, hi);
+}
+
+void CrossMatch::build_tree()
+{
+	dim.resize(pts.size());
+
+	// split the top of the tree serially, until there are enough
+	// subtrees to keep all threads busy, then build those in parallel
+	typedef std::pair<size_t, size_t> range;
+	std::vector<range> ranges(1, range(0, pts.size())), next;
+	bool more = true;
+	while(more && ranges.size() < 4*(size_t)nthreads)
+	{
+		more = false;
+		next.clear();
+		for(size_t i = 0; i != ranges.size(); i++)
+		{
+			const size_t lo = ranges[i].first, hi = ranges[i].second;
+			if(hi - lo <= LEAF) { next.push_back(ranges[i]); continue; }
+
+			const size_t mid = split(lo, hi);
+			next.push_back(range(lo, mid));
+			next.push_back(range(mid + 1, hi));
+			more = true;
+		}
+		ranges.swap(next);
+	}
+
+	if(nthreads == 1)
+	{
+		for(size_t i = 0; i != ranges.size(); i++) { build(ranges[i].first, ranges[i].second); }
+		return;
+	}
+
+	system::ThreadPool pool(nthreads);
+	for(size_t i = 0; i != ranges.size(); i++)
+	{
+		pool.submit(boost::bind(&CrossMatch::build, this, ranges[i].first, ranges[i].second));
+	}
+	pool.wait();
+}
+
+//
+// Tree searches
+//
+
+void CrossMatch::within(const V3 &p, double r2, size_t lo, size_t hi, size_t b, std::vector<Match> &out) const
+{
+	while(hi - lo > LEAF)
+	{
+		const size_t mid = lo + (hi - lo)/2;
+		const node &n = pts[mid];
+
+		const double c2 = dist2(p, n.v);
+		if(c2 <= r2)
+		{
+			Match m = { n.i, b, chord2angle(c2) };
+			out.push_back(m);
+		}
+
+		// descend into the near side; recurse into the far side if the
+		// splitting plane is within reach
+		const int d = dim[mid];
+		const double diff = p[d] - n.v[d];
+		if(diff < 0)
+		{
+			if(diff*diff <= r2) { within(p, r2, mid + 1, hi, b, out); }
+			hi = mid;
+		}
+		else
+		{
+			if(diff*diff <= r2) { within(p, r2, lo, mid, b, out); }
+			lo = mid + 1;
+		}
+	}
+
+	for(size_t i = lo; i != hi; i++)
+	{
+		const double c2 = dist2(p, pts[i].v);
+		if(c2 > r2) { continue; }
+
+		Match m = { pts[i].i, b, chord2angle(c2) };
+		out.push_back(m);
+	}
+}
+
+void CrossMatch::nearest(const V3 &p, size_t lo, size_t hi, size_t &best, double &best2) const
+{
+	if(hi - lo <= LEAF)
+	{
+		for(size_t i = lo; i != hi; i++)
+		{
+			const double c2 = dist2(p, pts[i].v);
+			if(c2 <= best2) { best2 = c2; best = i; }
+		}
+		return;
+	}
+
+	const size_t mid = lo + (hi - lo)/2;
+	const double c2 = dist2(p, pts[mid].v);
+	if(c2 <= best2) { best2 = c2; best = mid; }
+
+	const int d = dim[mid];
+	const double diff = p[d] - pts[mid].v[d];
+	if(diff < 0)
+	{
+		nearest(p, lo, mid, best, best2);
+		if(diff*diff <= best2) { nearest(p, mid + 1, hi, best, best2); }
+	}
+	else
+	{
+		nearest(p, mid + 1, hi, best, best2);
+		if(diff*diff <= best2) { nearest(p, lo, mid, best, best2); }
+	}
+}
+
+void CrossMatch::within(const V3 &p, Radians radius, std::vector<size_t> &out) const
+{
+	std::vector<Match> m;
+	within(p / abs(p), chord2(radius), 0, pts.size(), 0, m);
+
+	out.clear();
+	for(size_t i = 0; i != m.size(); i++) { out.push_back(m[i].a); }
+}
+
+bool CrossMatch::nearest(const V3 &p, Radians radius, size_t &a, Radians &dist) const
+{
+	size_t best = npos;
+	double best2 = chord2(radius);
+	nearest(p / abs(p), 0, pts.size(), best, best2);
+	if(best == npos) { return false; }
+
+	a = pts[best].i;
+	dist = chord2angle(best2);
+	return true;
+}
+
+//
+// Batch matching
+//
+
+void CrossMatch::match_range(const V3 *v, const double *lon, const double *lat, size_t from, size_t to, double r2, Mode mode, std::vector<Match> *out) const
+{
+	out->clear();
+	for(size_t b = from; b != to; b++)
+	{
+		const V3 p = v ? v[b] / abs(v[b]) : unitvec(lon[b], lat[b]);
+
+		if(mode == ALL)
+		{
+			within(p, r2, 0, pts.size(), b, *out);
+			continue;
+		}
+
+		size_t best = npos;
+		double best2 = r2;
+		nearest(p, 0, pts.size(), best, best2);
+		if(best == npos) { continue; }
+
+		Match m = { pts[best].i, b, chord2angle(best2) };
+		out->push_back(m);
+	}
+}
+
+void CrossMatch::match(const V3 *v, const double *lon, const double *lat, size_t n, Radians radius, Mode mode, const sink_t &sink) const
+{
+	const double r2 = chord2(radius);
+	std::vector<Match> buf;
+
+	if(nthreads == 1 || n <= chunk)
+	{
+		for(size_t from = 0; from < n; from += chunk)
+		{
+			match_range(v, lon, lat, from, std::min(n, from + chunk), r2, mode, &buf);
+			sink(buf);
+		}
+		return;
+	}
+
+	// in waves of four chunks per thread, passing the results of each
+	// wave to the sink in order once it has been matched
+	system::ThreadPool pool(nthreads);
+	std::vector<std::vector<Match> > parts(4*nthreads);
+	for(size_t from = 0; from < n;)
+	{
+		size_t k = 0;
+		for(; k != parts.size() && from < n; k++, from += chunk)
+		{
+			pool.submit(boost::bind(&CrossMatch::match_range, this, v, lon, lat, from, std::min(n, from + chunk), r2, mode, &parts[k]));
+		}
+		pool.wait();
+
+		for(size_t i = 0; i != k; i++) { sink(parts[i]); }
+	}
+}
+
+void CrossMatch::match(const V3 *v, size_t n, Radians radius, std::vector<Match> &out, Mode mode) const
+{
+	match(v, NULL, NULL, n, radius, mode, boost::bind(append_vector, &out, _1));
+}
+
+void CrossMatch::match(const double *lon, const double *lat, size_t n, Radians radius, std::vector<Match> &out, Mode mode) const
+{
+	match(NULL, lon, lat, n, radius, mode, boost::bind(append_vector, &out, _1));
+}
+
+void CrossMatch::match(const V3 *v, size_t n, Radians radius, system::DMMArray<Match> &out, Mode mode) const
+{
+	match(v, NULL, NULL, n, radius, mode, boost::bind(append_dmm, &out, _1));
+}
+
+void CrossMatch::match(const double *lon, const double *lat, size_t n, Radians radius, system::DMMArray<Match> &out, Mode mode) const
+{
+	match(NULL, lon, lat, n, radius, mode, boost::bind(append_dmm, &out, _1));
+}
@@ -0,0 +1,681 @@
+//
+// HEALPix pixelization. The pixel numbering algorithms follow those of
+// the reference C++ implementation (healpix_base.cc, Reinecke et al.),
+// restricted to nside = 2^order.
+//
+
+#include <astro/healpix.h>
+#include <astro/constants.h>
+#include <astro/exceptions.h>
+#include <astro/util.h>
+
+#include <cmath>
+#include <algorithm>
+
+using namespace peyton;
+using namespace peyton::coordinates;
+using namespace peyton::exceptions;
+using peyton::math::V3;
+
+typedef Healpix::pixel pixel;
+
+namespace {
+
+	const double twothird = 2.0/3.0;
+	const double halfpi = ctn::pi/2;
+	const double inv_halfpi = 2.0/ctn::pi;
+
+	// ring number (in units of nside) and phi offset of the southernmost
+	// corner of each of the 12 base pixels
+	const int jrll[12] = { 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4 };
+	const int jpll[12] = { 1, 3, 5, 7, 0, 2, 4, 6, 1, 3, 5, 7 };
+
+	inline pixel isqrt(pixel v)
+	{
+		pixel r = (pixel)std::sqrt((double)v + 0.5);
+		while(r*r > v) { --r; }
+		while((r+1)*(r+1) <= v) { ++r; }
+		return r;
+	}
+
+	// interleave the bits of v with zeros (bit i goes to bit 2i)
+	inline pixel spread_bits(pixel v)
+	{
+		unsigned long long x = (unsigned long long)v & 0xFFFFFFFFULL;
+		x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+		x = (x | (x <<  8)) & 0x00FF00FF00FF00FFULL;
+		x = (x | (x <<  4)) & 0x0F0F0F0F0F0F0F0FULL;
+		x = (x | (x <<  2)) & 0x3333333333333333ULL;
+		x = (x | (x <<  1)) & 0x5555555555555555ULL;
+		return (pixel)x;
+	}
+
+	// inverse of spread_bits (bit 2i goes to bit i; odd bits are ignored)
+	inline int compress_bits(pixel v)
+	{
+		unsigned long long x = (unsigned long long)v & 0x5555555555555555ULL;
+		x = (x | (x >>  1)) & 0x3333333333333333ULL;
+		x = (x | (x >>  2)) & 0x0F0F0F0F0F0F0F0FULL;
+		x = (x | (x >>  4)) & 0x00FF00FF00FF00FFULL;
+		x = (x | (x >>  8)) & 0x0000FFFF0000FFFFULL;
+		x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+		return (int)x;
+	}
+
+	inline double fmodulo(double v, double m)
+	{
+		if(v >= 0) { return v < m ? v : std::fmod(v, m); }
+		double r = std::fmod(v, m) + m;
+		return r == m ? 0. : r;
+	}
+
+	inline V3 zphi2vec(double z, double phi, double sth, bool have_sth)
+	{
+		if(!have_sth) { sth = std::sqrt((1.0 - z)*(1.0 + z)); }
+		return V3(sth*cos(phi), sth*sin(phi), z);
+	}
+
+	// angle between two unit vectors
+	inline double angle(const V3 &a, const V3 &b)
+	{
+		return atan2(abs(cross(a, b)), dot(a, b));
+	}
+
+	// position (x, y) in [0,1]^2 within base pixel face, to a vector
+	V3 xyf2vec(double x, double y, int face)
+	{
+		double jr = jrll[face] - x - y;
+		double nr, z, sth = 0;
+		bool have_sth = false;
+		if(jr < 1)
+		{
+			nr = jr;
+			double tmp = nr*nr/3.;
+			z = 1 - tmp;
+			if(z > 0.99) { sth = std::sqrt(tmp*(2.0-tmp)); have_sth = true; }
+		}
+		else if(jr > 3)
+		{
+			nr = 4 - jr;
+			double tmp = nr*nr/3.;
+			z = tmp - 1;
+			if(z < -0.99) { sth = std::sqrt(tmp*(2.-tmp)); have_sth = true; }
+		}
+		else
+		{
+			nr = 1;
+			z = (2 - jr)*2./3.;
+		}
+
+		double tmp = jpll[face]*nr + x - y;
+		if(tmp < 0) { tmp += 8; }
+		if(tmp >= 8) { tmp -= 8; }
+		double phi = (nr < 1e-15) ? 0 : (0.5*halfpi*tmp)/nr;
+
+		return zphi2vec(z, phi, sth, have_sth);
+	}
+
+} // namespace
+
+Healpix::Healpix(int order, Scheme scheme)
+	: order_(order), scheme_(scheme)
+{
+	if(order < 0 || order > 29) { THROW(EAny, "HEALPix order must be in [0, 29] (got " + util::str(order) + ")"); }
+
+	nside_ = 1LL << order;
+	npface_ = nside_ * nside_;
+	ncap_ = 2 * nside_ * (nside_ - 1);
+	npix_ = 12 * npface_;
+	fact2_ = 4. / npix_;
+	fact1_ = (nside_ << 1) * fact2_;
+}
+
+Radians Healpix::max_pixrad() const
+{
+	const double t1 = 1. - 1./nside_;
+	const double za = 2./3., zb = 1 - t1*t1/3.;
+	const V3 va = zphi2vec(za, ctn::pi/(4*nside_), 0, false);
+	const V3 vb = zphi2vec(zb, 0, 0, false);
+	return angle(va, vb);
+}
+
+//
+// (x, y, face) <-> pixel number conversions
+//
+
+pixel Healpix::xyf2nest(int ix, int iy, int face) const
+{
+	return ((pixel)face << (2*order_)) + spread_bits(ix) + (spread_bits(iy) << 1);
+}
+
+void Healpix::nest2xyf(pixel pix, int &ix, int &iy, int &face) const
+{
+	face = (int)(pix >> (2*order_));
+	pix &= npface_ - 1;
+	ix = compress_bits(pix);
+	iy = compress_bits(pix >> 1);
+}
+
+pixel Healpix::xyf2ring(int ix, int iy, int face) const
+{
+	const pixel nl4 = 4*nside_;
+	const pixel jr = jrll[face]*nside_ - ix - iy - 1;
+
+	pixel nr, n_before;
+	bool shifted;
+	if(jr < nside_)
+	{
+		nr = jr;
+		n_before = 2*nr*(nr - 1);
+		shifted = true;
+	}
+	else if(jr > 3*nside_)
+	{
+		nr = nl4 - jr;
+		n_before = npix_ - 2*(nr + 1)*nr;
+		shifted = true;
+	}
+	else
+	{
+		nr = nside_;
+		n_before = ncap_ + (jr - nside_)*nl4;
+		shifted = ((jr - nside_) & 1) == 0;
+	}
+
+	const pixel kshift = shifted ? 0 : 1;
+	pixel jp = (jpll[face]*nr + ix - iy + 1 + kshift) / 2;
+	if(jp > nl4) { jp -= nl4; }
+	else if(jp < 1) { jp += nl4; }
+
+	return n_before + jp - 1;
+}
+
+void Healpix::ring2xyf(pixel pix, int &ix, int &iy, int &face) const
+{
+	pixel iring, iphi, kshift, nr;
+	const pixel nl2 = 2*nside_;
+
+	if(pix < ncap_)
+	{
+		// north polar cap
+		iring = (1 + isqrt(1 + 2*pix)) >> 1;
+		iphi = (pix + 1) - 2*iring*(iring - 1);
+		kshift = 0;
+		nr = iring;
+		face = (int)((iphi - 1)/nr);
+	}
+	else if(pix < npix_ - ncap_)
+	{
+		// equatorial region
+		const pixel ip = pix - ncap_;
+		const pixel tmp = ip >> (order_ + 2);
+		iring = tmp + nside_;
+		iphi = ip - tmp*4*nside_ + 1;
+		kshift = (iring + nside_) & 1;
+		nr = nside_;
+		const pixel ire = tmp + 1, irm = nl2 + 1 - tmp;
+		const pixel ifm = (iphi - (ire >> 1) + nside_ - 1) >> order_;
+		const pixel ifp = (iphi - (irm >> 1) + nside_ - 1) >> order_;
+		face = (int)((ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : (ifm + 8)));
+	}
+	else
+	{
+		// south polar cap
+		const pixel ip = npix_ - pix;
+		iring = (1 + isqrt(2*ip - 1)) >> 1;
+		iphi = 4*iring + 1 - (ip - 2*iring*(iring - 1));
+		kshift = 0;
+		nr = iring;
+		iring = 2*nl2 - iring;
+		face = (int)((iphi - 1)/nr + 8);
+	}
+
+	const pixel irt = iring - ((2 + (face >> 2))*nside_) + 1;
+	pixel ipt = 2*iphi - jpll[face]*nr - kshift - 1;
+	if(ipt >= nl2) { ipt -= 8*nside_; }
+
+	ix = (int)((ipt - irt) >> 1);
+	iy = (int)((-ipt - irt) >> 1);
+}
+
+pixel Healpix::nest2ring(pixel pix) const
+{
+	int ix, iy, face;
+	nest2xyf(pix, ix, iy, face);
+	return xyf2ring(ix, iy, face);
+}
+
+pixel Healpix::ring2nest(pixel pix) const
+{
+	int ix, iy, face;
+	ring2xyf(pix, ix, iy, face);
+	return xyf2nest(ix, iy, face);
+}
+
+//
+// Position <-> pixel conversions
+//
+
+pixel Healpix::loc2pix(double z, double phi, double sth, bool have_sth) const
+{
+	const double za = std::fabs(z);
+	const double tt = fmodulo(phi*inv_halfpi, 4.0);	// in [0,4)
+
+	if(za <= twothird)
+	{
+		// equatorial region
+		const double temp1 = nside_*(0.5 + tt);
+		const double temp2 = nside_*(z*0.75);
+		const pixel jp = (pixel)(temp1 - temp2);	// index of ascending edge line
+		const pixel jm = (pixel)(temp1 + temp2);	// index of descending edge line
+
+		if(scheme_ == RING)
+		{
+			const pixel nl4 = 4*nside_;
+			const pixel ir = nside_ + 1 + jp - jm;	// ring number counted from z = 2/3
+			const pixel kshift = 1 - (ir & 1);
+			const pixel ip = ((jp + jm - nside_ + kshift + 1 + 2*nl4) >> 1) & (nl4 - 1);
+			return ncap_ + (ir - 1)*nl4 + ip;
+		}
+
+		const pixel ifp = jp >> order_;
+		const pixel ifm = jm >> order_;
+		const int face = (int)((ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : (ifm + 8)));
+		const int ix = (int)(jm & (nside_ - 1));
+		const int iy = (int)(nside_ - (jp & (nside_ - 1)) - 1);
+		return xyf2nest(ix, iy, face);
+	}
+
+	// polar regions
+	const int ntt = std::min(3, (int)tt);
+	const double tp = tt - ntt;
+	const double tmp = (za < 0.99 || !have_sth) ?
+		nside_*std::sqrt(3*(1 - za)) :
+		nside_*sth/std::sqrt((1. + za)/3.);
+
+	pixel jp = (pixel)(tp*tmp);		// increasing edge line index
+	pixel jm = (pixel)((1.0 - tp)*tmp);	// decreasing edge line index
+	jp = std::min(jp, nside_ - 1);		// for points too close to the boundary
+	jm = std::min(jm, nside_ - 1);
+
+	if(scheme_ == RING)
+	{
+		const pixel ir = jp + jm + 1;		// ring number counted from the closest pole
+		pixel ip = (pixel)(tt*ir);
+		if(ip >= 4*ir) { ip -= 4*ir; }
+		return (z > 0) ? 2*ir*(ir - 1) + ip : npix_ - 2*ir*(ir + 1) + ip;
+	}
+
+	return (z >= 0) ?
+		xyf2nest((int)(nside_ - jm - 1), (int)(nside_ - jp - 1), ntt) :
+		xyf2nest((int)jp, (int)jm, ntt + 8);
+}
+
+void Healpix::pix2loc(pixel pix, double &z, double &phi, double &sth, bool &have_sth) const
+{
+	int ix, iy, face;
+	pix2xyf(pix, ix, iy, face);
+
+	have_sth = false;
+	const pixel jr = ((pixel)jrll[face] << order_) - ix - iy - 1;
+
+	pixel nr;
+	if(jr < nside_)
+	{
+		nr = jr;
+		const double tmp = (nr*nr)*fact2_;
+		z = 1 - tmp;
+		if(z > 0.99) { sth = std::sqrt(tmp*(2.0 - tmp)); have_sth = true; }
+	}
+	else if(jr > 3*nside_)
+	{
+		nr = nside_*4 - jr;
+		const double tmp = (nr*nr)*fact2_;
+		z = tmp - 1;
+		if(z < -0.99) { sth = std::sqrt(tmp*(2.0 - tmp)); have_sth = true; }
+	}
+	else
+	{
+		nr = nside_;
+		z = (2*nside_ - jr)*fact1_;
+	}
+
+	pixel tmp = (pixel)jpll[face]*nr + ix - iy;
+	if(tmp < 0) { tmp += 8*nr; }
+	phi = (nr == nside_) ? 0.75*halfpi*tmp*fact1_ : (0.5*halfpi*tmp)/nr;
+}
+
+pixel Healpix::ang2pix(Radians lon, Radians lat) const
+{
+	return loc2pix(sin(lat), lon, cos(lat), true);
+}
+
+pixel Healpix::vec2pix(const V3 &v) const
+{
+	const double xl = 1./abs(v);
+	const double phi = atan2(v.y, v.x);
+	const double sth = std::sqrt(v.x*v.x + v.y*v.y)*xl;
+	return loc2pix(v.z*xl, phi, sth, true);
+}
+
+void Healpix::pix2ang(pixel pix, Radians &lon, Radians &lat) const
+{
+	double z, phi, sth;
+	bool have_sth;
+	pix2loc(pix, z, phi, sth, have_sth);
+
+	lon = phi;
+	lat = have_sth ? (z < 0 ? -1 : 1) * acos(sth) : asin(z);
+}
+
+V3 Healpix::pix2vec(pixel pix) const
+{
+	double z, phi, sth;
+	bool have_sth;
+	pix2loc(pix, z, phi, sth, have_sth);
+	return zphi2vec(z, phi, sth, have_sth);
+}
+
+void Healpix::ang2pix(const double *lon, const double *lat, pixel *pix, size_t n) const
+{
+	for(size_t i = 0; i != n; i++) { pix[i] = ang2pix(lon[i], lat[i]); }
+}
+
+void Healpix::vec2pix(const V3 *v, pixel *pix, size_t n) const
+{
+	for(size_t i = 0; i != n; i++) { pix[i] = vec2pix(v[i]); }
+}
+
+void Healpix::pix2ang(const pixel *pix, double *lon, double *lat, size_t n) const
+{
+	for(size_t i = 0; i != n; i++) { pix2ang(pix[i], lon[i], lat[i]); }
+}
+
+void Healpix::pix2vec(const pixel *pix, V3 *v, size_t n) const
+{
+	for(size_t i = 0; i != n; i++) { v[i] = pix2vec(pix[i]); }
+}
+
+void Healpix::corners(pixel pix, V3 c[4]) const
+{
+	int ix, iy, face;
+	pix2xyf(pix, ix, iy, face);
+
+	const double dc = 0.5 / nside_;
+	const double xc = (ix + 0.5)/nside_, yc = (iy + 0.5)/nside_;
+
+	c[0] = xyf2vec(xc + dc, yc + dc, face);
+	c[1] = xyf2vec(xc - dc, yc + dc, face);
+	c[2] = xyf2vec(xc - dc, yc - dc, face);
+	c[3] = xyf2vec(xc + dc, yc - dc, face);
+}
+
+void Healpix::neighbours(pixel pix, pixel nb[8]) const
+{
+	static const int xoffset[8] = { -1,-1, 0, 1, 1, 1, 0,-1 };
+	static const int yoffset[8] = {  0, 1, 1, 1, 0,-1,-1,-1 };
+
+	// base pixel across each of the (3x3 arrangement of) edges and corners
+	static const int facearray[9][12] = {
+		{  8, 9,10,11,-1,-1,-1,-1,10,11, 8, 9 },	// S
+		{  5, 6, 7, 4, 8, 9,10,11, 9,10,11, 8 },	// SE
+		{ -1,-1,-1,-1, 5, 6, 7, 4,-1,-1,-1,-1 },	// E
+		{  4, 5, 6, 7,11, 8, 9,10,11, 8, 9,10 },	// SW
+		{  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11 },	// center
+		{  1, 2, 3, 0, 0, 1, 2, 3, 5, 6, 7, 4 },	// NE
+		{ -1,-1,-1,-1, 7, 4, 5, 6,-1,-1,-1,-1 },	// W
+		{  3, 0, 1, 2, 3, 0, 1, 2, 4, 5, 6, 7 },	// NW
+		{  2, 3, 0, 1,-1,-1,-1,-1, 0, 1, 2, 3 }		// N
+	};
+	// coordinate flips needed when crossing into the neighbouring base pixel
+	// (1: x -> nside-x-1, 2: y -> nside-y-1, 4: swap x and y)
+	static const int swaparray[9][3] = {
+		{ 0,0,3 },	// S
+		{ 0,0,6 },	// SE
+		{ 0,0,0 },	// E
+		{ 0,0,5 },	// SW
+		{ 0,0,0 },	// center
+		{ 5,0,0 },	// NE
+		{ 0,0,0 },	// W
+		{ 6,0,0 },	// NW
+		{ 3,0,0 }	// N
+	};
+
+	int ix, iy, face;
+	pix2xyf(pix, ix, iy, face);
+
+	const int ns = (int)nside_;
+	for(int i = 0; i != 8; i++)
+	{
+		int x = ix + xoffset[i], y = iy + yoffset[i];
+		int nbnum = 4;
+		if(x < 0)		{ x += ns; nbnum -= 1; }
+		else if(x >= ns)	{ x -= ns; nbnum += 1; }
+		if(y < 0)		{ y += ns; nbnum -= 3; }
+		else if(y >= ns)	{ y -= ns; nbnum += 3; }
+
+		const int f = facearray[nbnum][face];
+		if(f < 0) { nb[i] = -1; continue; }
+
+		const int bits = swaparray[nbnum][face >> 2];
+		if(bits & 1) { x = ns - x - 1; }
+		if(bits & 2) { y = ns - y - 1; }
+		if(bits & 4) { std::swap(x, y); }
+		nb[i] = xyf2pix(x, y, f);
+	}
+}
+
+//
+// Region queries. Starting from the 12 base pixels, pixels are tested
+// against the region using their bounding circles, and subdivided until
+// they are found to lie entirely within or outside of it, or the target
+// order is reached.
+//
+
+struct Healpix::region
+{
+	enum { OUTSIDE, PARTIAL, INSIDE };
+
+	/// is the circle of radius r around unit vector p outside, inside, or partially within the region
+	virtual int classify(const V3 &p, double r) const = 0;
+	/// is the point within the region
+	virtual bool contains(const V3 &p) const = 0;
+
+	virtual ~region() {}
+};
+
+namespace {
+
+	typedef Healpix::region region;
+
+	// intersection of half-spaces dot(n[i], p) >= 0
+	struct halfspaces : public region
+	{
+		std::vector<V3> n;
+
+		int classify(const V3 &p, double r) const
+		{
+			if(r >= halfpi) { return PARTIAL; }
+
+			const double s = sin(r);
+			bool inside = true;
+			for(size_t i = 0; i != n.size(); i++)
+			{
+				const double d = dot(n[i], p);
+				if(d < -s) { return OUTSIDE; }
+				inside = inside && d > s;
+			}
+			return inside ? INSIDE : PARTIAL;
+		}
+
+		bool contains(const V3 &p) const
+		{
+			for(size_t i = 0; i != n.size(); i++)
+			{
+				if(dot(n[i], p) < 0) { return false; }
+			}
+			return true;
+		}
+	};
+
+	struct disc : public region
+	{
+		V3 c;
+		double radius;
+
+		disc(const V3 &c_, double radius_) : c(c_ / abs(c_)), radius(radius_) {}
+
+		int classify(const V3 &p, double r) const
+		{
+			const double d = angle(c, p);
+			if(d > radius + r) { return OUTSIDE; }
+			if(d + r < radius) { return INSIDE; }
+			return PARTIAL;
+		}
+
+		bool contains(const V3 &p) const { return angle(c, p) <= radius; }
+	};
+
+	struct box : public region
+	{
+		double latlo, lathi;
+		halfspaces wedge;	// longitude range, or its complement
+		bool complement;	// the box is the complement of the wedge
+		bool all_lon;
+
+		box(Radians lonlo, Radians latlo_, Radians lonhi, Radians lathi_)
+			: latlo(latlo_), lathi(lathi_)
+		{
+			double w = lonhi - lonlo;
+			if(w < 0) { w += ctn::pi2; }
+			all_lon = w >= ctn::pi2 || (lonhi - lonlo) >= ctn::pi2;
+			complement = w > ctn::pi;
+			if(complement) { std::swap(lonlo, lonhi); }
+
+			// east of the lonlo meridian, and west of the lonhi meridian
+			wedge.n.push_back(V3(-sin(lonlo), cos(lonlo), 0.));
+			wedge.n.push_back(V3(sin(lonhi), -cos(lonhi), 0.));
+		}
+
+		int classify(const V3 &p, double r) const
+		{
+			const double lat = atan2(p.z, std::sqrt(p.x*p.x + p.y*p.y));
+			if(lat - r > lathi || lat + r < latlo) { return OUTSIDE; }
+			int ret = (lat - r >= latlo && lat + r <= lathi) ? INSIDE : PARTIAL;
+
+			if(all_lon) { return ret; }
+
+			int w = wedge.classify(p, r);
+			if(complement) { w = w == INSIDE ? OUTSIDE : (w == OUTSIDE ? INSIDE : PARTIAL); }
+
+			if(w == OUTSIDE) { return OUTSIDE; }
+			return (w == INSIDE && ret == INSIDE) ? INSIDE : PARTIAL;
+		}
+
+		bool contains(const V3 &p) const
+		{
+			const double lat = atan2(p.z, std::sqrt(p.x*p.x + p.y*p.y));
+			if(lat < latlo || lat > lathi) { return false; }
+			return all_lon || (wedge.contains(p) != complement);
+		}
+	};
+
+	void add_range(std::vector<Healpix::range> &out, pixel begin, pixel end)
+	{
+		if(!out.empty() && out.back().second == begin) { out.back().second = end; }
+		else { out.push_back(Healpix::range(begin, end)); }
+	}
+
+} // namespace
+
+void Healpix::query(const region &r, std::vector<range> &out, bool inclusive) const
+{
+	out.clear();
+
+	// Pixelizations (in NEST scheme) and pixel radii for each order. The
+	// radii are padded to absorb roundoff in the distance computations.
+	std::vector<Healpix> levels;
+	std::vector<double> radius;
+	for(int k = 0; k <= order_; k++)
+	{
+		levels.push_back(Healpix(k, NEST));
+		radius.push_back(levels.back().max_pixrad() * 1.01 + 1e-10);
+	}
+
+	std::vector<range> nest;
+	std::vector<std::pair<int, pixel> > stack;	// (order, pixel)
+	for(int p = 11; p >= 0; p--) { stack.push_back(std::make_pair(0, (pixel)p)); }
+
+	while(!stack.empty())
+	{
+		const int k = stack.back().first;
+		const pixel p = stack.back().second;
+		stack.pop_back();
+
+		const V3 c = levels[k].pix2vec(p);
+		const int shift = 2*(order_ - k);
+
+		int cls = r.classify(c, radius[k]);
+		if(k == order_ && cls == region::PARTIAL)
+		{
+			cls = (inclusive || r.contains(c)) ? region::INSIDE : region::OUTSIDE;
+		}
+
+		if(cls == region::OUTSIDE) { continue; }
+		if(cls == region::INSIDE)
+		{
+			add_range(nest, p << shift, (p + 1) << shift);
+			continue;
+		}
+
+		// subdivide; the children are pushed in reverse, so they're popped in order
+		for(int i = 3; i >= 0; i--) { stack.push_back(std::make_pair(k + 1, 4*p + i)); }
+	}
+
+	if(scheme_ == NEST)
+	{
+		out.swap(nest);
+		return;
+	}
+
+	// renumber to RING scheme
+	std::vector<pixel> pix;
+	for(size_t i = 0; i != nest.size(); i++)
+	{
+		for(pixel p = nest[i].first; p != nest[i].second; p++) { pix.push_back(nest2ring(p)); }
+	}
+	std::sort(pix.begin(), pix.end());
+	for(size_t i = 0; i != pix.size(); i++) { add_range(out, pix[i], pix[i] + 1); }
+}
+
+void Healpix::query_disc(const V3 &center, Radians radius, std::vector<range> &out, bool inclusive) const
+{
+	query(disc(center, radius), out, inclusive);
+}
+
+void Healpix::query_polygon(const std::vector<V3> &v, std::vector<range> &out, bool inclusive) const
+{
+	if(v.size() < 3) { THROW(EAny, "A polygon needs at least three vertices"); }
+
+	halfspaces poly;
+	V3 mid(0., 0., 0.);
+	for(size_t i = 0; i != v.size(); i++)
+	{
+		V3 n = cross(v[i], v[(i + 1) % v.size()]);
+		poly.n.push_back(n / abs(n));
+		mid += v[i];
+	}
+
+	// orient the edges so that the polygon is on their positive side
+	if(dot(poly.n[0], mid) < 0)
+	{
+		for(size_t i = 0; i != poly.n.size(); i++) { poly.n[i] = -poly.n[i]; }
+	}
+
+	query(poly, out, inclusive);
+}
+
+void Healpix::query_box(Radians lonlo, Radians latlo, Radians lonhi, Radians lathi, std::vector<range> &out, bool inclusive) const
+{
+	query(box(lonlo, latlo, lonhi, lathi), out, inclusive);
+}
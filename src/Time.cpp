@@ -1,6 +1,9 @@
 #include <astro/time.h>
+#include <astro/io/format.h>
 #include <stdio.h>
 
+#include <algorithm>
+
 void peyton::time::MJD2cal(double J, int &year, int &month, double &dd)
 {
 	// convert to JD
@@ -149,3 +152,130 @@ char *peyton::time::toMPECTimeFormat(char *str, MJD time)
 	return str;
 }
 
+
+//
+// Array versions. Within the Gregorian calendar, MJD2cal() and calToJD()
+// reduce to the proleptic Gregorian calendar, which MJD2cal() looks up in
+// tables of the Julian day numbers of January 1 of each year, and of the
+// month and day of each day of the year. calToJD() evaluates the scalar
+// arithmetic without its branches. Dates outside of the tables are
+// converted by the scalar functions.
+//
+
+namespace {
+
+	const int YEAR0 = 1583, YEAR1 = 10000;	// years covered by the tables
+
+	struct calendar_tables
+	{
+		int jan1[YEAR1 - YEAR0 + 2];	///< JDN of January 1 of year YEAR0 + i
+		short md[2][366];		///< month*32 + day of day-of-year i, for common and leap years
+
+		calendar_tables()
+		{
+			for(int y = YEAR0; y <= YEAR1 + 1; y++)
+			{
+				// days from 0000 Mar 1 to y Jan 1, plus the JDN of 0000 Mar 1
+				const int yy = y - 1, era = yy / 400, yoe = yy - era * 400;
+				jan1[y - YEAR0] = era * 146097 + yoe * 365 + yoe/4 - yoe/100 + 306 + 1721120;
+			}
+
+			const int mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+			for(int leap = 0; leap != 2; leap++)
+			{
+				int doy = 0;
+				for(int m = 1; m <= 12; m++)
+				{
+					const int len = mdays[m-1] + (leap && m == 2);
+					for(int d = 1; d <= len; d++) { md[leap][doy++] = m * 32 + d; }
+				}
+			}
+		}
+	};
+
+	const calendar_tables &tables()
+	{
+		static const calendar_tables t;
+		return t;
+	}
+
+}
+
+void peyton::time::MJD2cal(const double *mjd, int *year, int *month, double *dd, size_t n)
+{
+	const calendar_tables &t = tables();
+	const double Jlo = t.jan1[0] - 0.5, Jhi = t.jan1[YEAR1 - YEAR0] - 0.5;
+
+	for(size_t i = 0; i != n; i++)
+	{
+		const double J = mjd[i] + 2400000.5;
+		if(!(J >= Jlo && J < Jhi))
+		{
+			MJD2cal(mjd[i], year[i], month[i], dd[i]);
+			continue;
+		}
+		const long jd = J + 0.5;
+
+		// estimate the year, and correct by at most one
+		int y = (int)((jd - t.jan1[0]) * (1. / 365.2425));
+		y -= jd < t.jan1[y];
+		y += jd >= t.jan1[y + 1];
+
+		const int doy = jd - t.jan1[y];
+		const int leap = t.jan1[y + 1] - t.jan1[y] - 365;
+		const int md = t.md[leap][doy];
+		const int day = md & 31;
+
+		year[i] = y + YEAR0;
+		month[i] = md >> 5;
+		dd[i] = day + J - jd + 0.5;
+	}
+}
+
+void peyton::time::calToJD(const int *yX, const int *mX, const int *dX, const double *h, double *jd, size_t n)
+{
+	for(size_t i = 0; i != n; i++)
+	{
+		const long m = mX[i] <= 2 ? mX[i] + 12 : mX[i];
+		const long y = yX[i] + 4800 - (mX[i] <= 2);
+		const long e = (306 * (m+1))/10;
+		const long a = y/100;
+		const long b = (a/4) - a;
+		const long c = (36525 * y)/100;
+
+		jd[i] = b + c + e + (dX[i] + h[i]/24.0) - 32167.5;
+	}
+
+	for(size_t i = 0; i != n; i++)
+	{
+		if(yX[i] < YEAR0 || yX[i] >= YEAR1 || mX[i] < 1 || mX[i] > 12) { jd[i] = calToJD(yX[i], mX[i], dX[i], h[i]); }
+	}
+}
+
+void peyton::time::calToMJD(const int *y, const int *m, const int *d, const double *h, double *mjd, size_t n)
+{
+	calToJD(y, m, d, h, mjd, n);
+	for(size_t i = 0; i != n; i++) { mjd[i] -= 2400000.5; }
+}
+
+void peyton::time::toMPECTimeFormat(const MJD *time, size_t n, std::vector<std::string> &out)
+{
+	static const io::compiled_format fmt("%d %02d %8.5f");
+
+	const size_t block = 1024;
+	int y[block], m[block]; double d[block];
+
+	out.resize(n);
+	for(size_t at = 0; at < n; at += block)
+	{
+		const size_t len = std::min(block, n - at);
+		MJD2cal(time + at, y, m, d, len);
+
+		for(size_t i = 0; i != len; i++)
+		{
+			std::string &s = out[at + i];
+			s.clear();
+			fmt.into(s) << y[i] << m[i] << d[i];
+		}
+	}
+}
@@ -5,9 +5,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <utility>
+
 #include "catalogs/BowellCatalog.h"
 #include "catalogs/NativeCatalog.h"
 #include "catalogs/MemoryCatalog.h"
+#include "catalogs/MappedCatalog.h"
 
 #pragma warning(disable: 4786)
 
@@ -25,6 +29,8 @@ Catalog *Catalog::open(const char *filename, const char *type, const char *mode)
 		cat = new BowellCatalog;
 	} else if(!stricmp(type, "NATIVE")) {
 		cat = new NativeCatalog;
+	} else if(!stricmp(type, "NATIVE-MMAP")) {
+		cat = new MappedCatalog;
 #if defined(HAVE_FMEMOPEN)
 	} else if(!stricmp(type, "NATIVE-MEMORY")) {
 		cat = new MemoryCatalog;
@@ -43,12 +49,81 @@ Catalog *Catalog::open(const char *filename, const char *type, const char *mode)
 	}
 }
 
+int Catalog::read(std::vector<Asteroid> &obj, const int from, const int to)
+{
+	int n = readAt(obj, from, to);
+	if(n != -1) { cursor = from + n; }
+
+	return n;
+}
+
+int Catalog::read(Asteroid &obj, const int id_in)
+{
+	const int id = id_in == -1 ? cursor : id_in;
+	cursor = id + 1;
+
+	return readAt(obj, id);
+}
+
 int Catalog::read(std::vector<Asteroid> &o, int *ids, int num)
 {
+	// ids with special meaning (-1 = next record) are read one by one
+	if(std::find(ids, ids + num, -1) != ids + num) {
+		o.erase(o.begin(), o.end());
+		o.resize(num);
+		for(int j = 0; j != num; j++) { read(o[j], ids[j]); }
+		return num;
+	}
+
+	// leave the position after the last id, as reading them one by one would
+	int n = readAt(o, ids, num);
+	if(num > 0) { cursor = ids[num - 1] + 1; }
+
+	return n;
+}
+
+//
+// Reads the records in order of their ids, coalescing ids closer than
+// maxGap records into a single range read (reading the records in between
+// is cheaper than seeking past them), and scatters them into o.
+//
+int Catalog::readAt(std::vector<Asteroid> &o, const int *ids, int num) const
+{
+	const int maxGap = 32;		// largest number of unrequested records read through
+	const int maxRun = 65536;	// longest range read at once
+
 	o.erase(o.begin(), o.end());
 	o.resize(num);
+
+	// positions in o, sorted by id
+	const int cnt = recordCount();
+	std::vector<std::pair<int, int> > order;
+	order.reserve(num);
 	for(int i = 0; i != num; i++) {
-		read(o[i], ids[i]);
+		if(ids[i] < 0 || ids[i] >= cnt) {
+			// invalid ids are left to fail on their own
+			readAt(o[i], ids[i]);
+			continue;
+		}
+		order.push_back(std::make_pair(ids[i], i));
+	}
+	std::sort(order.begin(), order.end());
+
+	std::vector<Asteroid> run;
+	const int nvalid = order.size();
+	for(int i = 0; i != nvalid;) {
+		const int from = order[i].first;
+		int j = i + 1;
+		while(j != nvalid && order[j].first - order[j-1].first <= maxGap && order[j].first - from < maxRun) { j++; }
+		const int to = order[j-1].first + 1;
+
+		if(readAt(run, from, to) != to - from) {
+			// fall back to reading one by one
+			for(; i != j; i++) { readAt(o[order[i].second], order[i].first); }
+			continue;
+		}
+
+		for(; i != j; i++) { o[order[i].second] = run[order[i].first - from]; }
 	}
 
 	return num;
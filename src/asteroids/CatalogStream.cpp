@@ -0,0 +1,113 @@
+#include <astro/asteroids/catalogstream.h>
+#include <astro/exceptions.h>
+#include <astro/util.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+using namespace peyton;
+using namespace peyton::exceptions;
+using namespace peyton::asteroids;
+
+CatalogStream::CatalogStream(const Catalog &cat_, int chunkLen_, int from_, int to_)
+: cat(cat_), from(from_), to(to_), chunkLen(chunkLen_), filled(0), released(0), stopping(false)
+{
+	if(chunkLen <= 0) { THROW(ECatalog, "Chunk length must be positive"); }
+
+	const int cnt = cat.recordCount();
+	if(to < 0 || to > cnt) { to = cnt; }
+	if(from < 0) { from = 0; }
+	nchunks = from < to ? (to - from + chunkLen - 1) / chunkLen : 0;
+
+	failed[0] = failed[1] = false;
+
+	boost::thread t(boost::bind(&CatalogStream::read_ahead, this));
+	reader.swap(t);
+}
+
+CatalogStream::~CatalogStream()
+{
+	{
+		boost::mutex::scoped_lock l(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	reader.join();
+}
+
+//
+// Reader thread: reads chunk k into slot[k % 2] as soon as chunk k-2 (the
+// previous occupant of the slot) has been released by the caller.
+//
+void CatalogStream::read_ahead()
+{
+	for(int k = 0; k != nchunks; k++)
+	{
+		{
+			boost::mutex::scoped_lock l(lock);
+			while(k - released >= 2 && !stopping) { changed.wait(l); }
+			if(stopping) { return; }
+		}
+
+		chunk &c = slot[k % 2];
+		c.from = from + k * chunkLen;
+		const int end = std::min(to, c.from + chunkLen);
+
+		// errors are handed over to wait(), which throws them on the
+		// caller's thread; an exception escaping here would terminate
+		bool ok;
+		try
+		{
+			ok = cat.readAt(c.obj, c.from, end) == end - c.from;
+		}
+		catch(...)
+		{
+			ok = false;
+		}
+
+		{
+			boost::mutex::scoped_lock l(lock);
+			failed[k % 2] = !ok;
+			filled = k + 1;
+		}
+		changed.notify_all();
+	}
+}
+
+// wait for chunk k to be read
+void CatalogStream::wait(int k)
+{
+	if(k >= nchunks) { return; }
+
+	bool ok;
+	{
+		boost::mutex::scoped_lock l(lock);
+		while(filled <= k) { changed.wait(l); }
+		ok = !failed[k % 2];
+	}
+
+	if(!ok)
+	{
+		const chunk &c = slot[k % 2];
+		THROW(ECatalog, "Error reading catalog records " + util::str(c.from) + " to " + util::str(std::min(to, c.from + chunkLen)));
+	}
+}
+
+// done with chunk k; move on to the next one
+void CatalogStream::advance(int k)
+{
+	{
+		boost::mutex::scoped_lock l(lock);
+		released = k + 1;
+	}
+	changed.notify_all();
+
+	wait(k + 1);
+}
+
+CatalogStream::iterator CatalogStream::begin()
+{
+	wait(0);
+	return iterator(this, 0);
+}
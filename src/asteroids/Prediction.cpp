@@ -0,0 +1,291 @@
+//
+// Prediction of asteroids falling into the fields of view of SDSS runs.
+//
+
+#include <astro/asteroids/prediction.h>
+#include <astro/coordinates.h>
+#include <astro/constants.h>
+#include <astro/system/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace peyton;
+using namespace peyton::asteroids;
+using namespace peyton::coordinates;
+using peyton::math::V3;
+
+namespace {
+
+	const double c_auday = 173.1446327;		// speed of light, AU/day
+	const double ltmax = 0.05;			// light time allowed for by the margins (days, ~8.7 AU)
+	const Radians slack = 2. * ctn::d2r / 60.;	// added to all margins
+	const Radians segLen = 10. * ctn::d2r;		// longest stripe segment queried as one polygon
+
+	const Transform ecl2equ = Transform::eclequ();
+
+	struct earlier
+	{
+		bool operator()(const Observation &a, const Observation &b) const { return a.t0 < b.t0; }
+	};
+
+	// time at which the scan, moving along mu at the sidereal rate, passes
+	// over mu (up to 6 hours before tstart for points behind the start of
+	// the stripe)
+	inline MJD scan_time(const sdss::RunGeometry &g, Radians mu)
+	{
+		const Radians dmu = mu - g.muStart;
+		return g.tstart + (dmu - ctn::pi2 * floor(dmu / ctn::pi2 + 0.25)) / ctn::pi2;
+	}
+
+	// H, G magnitude system (Bowell et al. 1989)
+	double phase_function(double G, Radians alpha)
+	{
+		const double t = tan(alpha / 2.);
+		const double phi1 = exp(-3.33 * pow(t, 0.63));
+		const double phi2 = exp(-1.87 * pow(t, 1.22));
+		return -2.5 * log10((1. - G)*phi1 + G*phi2);
+	}
+
+}
+
+void asteroids::earth(MJD t, V3 &r, V3 &v)
+{
+	// mean elements of the Earth-Moon barycenter, and their rates per Julian century
+	const double T = (t - 51544.5) / 36525.;
+	const double a = 1.00000261 + 0.00000562*T;
+	const double e = 0.01671123 - 0.00004392*T;
+	const double inc = (-0.00001531 - 0.01294668*T) * ctn::d2r;
+	const double L = (100.46457166 + 35999.37244981*T) * ctn::d2r;
+	const double varpi = (102.93768193 + 0.32327364*T) * ctn::d2r;
+	const double nn = 35999.37244981 * ctn::d2r / 36525.;
+
+	const double E = kepler(fmod(L - varpi, ctn::pi2), e);
+	const double sE = sin(E), cE = cos(E);
+	const double b = a * sqrt(1. - e*e);
+	const double f = nn / (1. - e*cE);
+	const double x = a * (cE - e), y = b * sE;
+	const double vx = -a * f * sE, vy = b * f * cE;
+
+	// the node is at 0 longitude
+	const double ci = cos(inc), si = sin(inc);
+	const double cw = cos(varpi), sw = sin(varpi);
+	const V3 P(cw, sw*ci, sw*si), Q(-sw, cw*ci, cw*si);
+	r = x*P + y*Q;
+	v = vx*P + vy*Q;
+}
+
+FieldPredictor::FieldPredictor(const std::vector<Asteroid> &obj_, double step_, int nthreads)
+	: obj(obj_.empty() ? NULL : &obj_[0]), n(obj_.size()), prop(obj_, nthreads), hpx(6),
+	  step(step_), maxRate(ctn::d2r)
+{
+}
+
+FieldPredictor::FieldPredictor(const Asteroid *obj_, size_t n_, double step_, int nthreads)
+	: obj(obj_), n(n_), prop(obj_, n_, nthreads), hpx(6),
+	  step(step_), maxRate(ctn::d2r)
+{
+}
+
+void FieldPredictor::take_snapshot(MJD t, snapshot &s) const
+{
+	s.t = t;
+	s.u.resize(n);
+	s.rate.resize(n);
+	s.cells.clear();
+	s.fast.clear();
+	if(n == 0) { return; }
+
+	std::vector<V3> r(n), v(n);
+	prop(t, &r[0], &v[0]);
+
+	V3 re, ve;
+	earth(t, re, ve);
+
+	for(size_t i = 0; i != n; i++)
+	{
+		const V3 rho = r[i] - re, rhodot = v[i] - ve;
+		const double dist = abs(rho);
+		const V3 u = rho / dist;
+
+		s.u[i] = ecl2equ(u);
+		s.rate[i] = abs(rhodot - dot(rhodot, u)*u) / dist;
+
+		if(s.rate[i] <= maxRate)
+		{
+			s.cells.push_back(std::make_pair(hpx.vec2pix(s.u[i]), i));
+		}
+		else
+		{
+			s.fast.push_back(i);
+		}
+	}
+	std::sort(s.cells.begin(), s.cells.end());
+
+	DEBUG(verb1) << "Snapshot at " << t << ": " << s.fast.size() << " fast moving objects";
+}
+
+//
+// Propagate object i to the time the scan passes over it, and fill in
+// the observation if it falls within the mask. mu is the approximate
+// position of the object along the stripe.
+//
+bool FieldPredictor::refine(size_t i, const sdss::RunGeometry &g, sdss::Mask &mask, Radians mu, Observation &o) const
+{
+	V3 r, v, re, ve, rho;
+	Radians ra = 0, dec = 0, nu = 0;
+	MJD t = scan_time(g, mu);
+	double lt = 0;
+	for(int k = 0; k != 10; k++)
+	{
+		earth(t, re, ve);
+		prop(i, t - lt, r, v);
+		rho = r - re;
+		lt = abs(rho) / c_auday;
+
+		lonlat(ecl2equ(rho), ra, dec);
+		equgcs(g.node, g.inc, ra, dec, mu, nu);
+
+		const MJD t1 = scan_time(g, mu);
+		const bool done = std::fabs(t1 - t) < 1e-8;
+		t = t1;
+		if(done) { break; }
+	}
+
+	if(!mask.contains(mu, nu)) { return false; }
+
+	const Asteroid &a = obj[i];
+	const double R = abs(r), dist = abs(rho);
+	const Radians phase = acos(std::max(-1., std::min(1., dot(r, rho) / (R*dist))));
+
+	// rates of motion along ra (including cos(dec)) and dec
+	const V3 rhodot = ecl2equ(v - ve);
+	const V3 east(-sin(ra), cos(ra), 0.), north(-sin(dec)*cos(ra), -sin(dec)*sin(ra), cos(dec));
+
+	o = Observation();
+	o.t0 = t;
+	strncpy(o.name, a.name, Observation::maxNameLen);
+	o.name[Observation::maxNameLen] = 0;
+	o.id = a.id;
+	o.ra = ra;
+	o.dec = dec;
+	o.dra = dot(rhodot, east) / dist;
+	o.ddec = dot(rhodot, north) / dist;
+	o.umag = a.h + 5.*log10(R*dist);
+	o.mag = o.umag + phase_function(a.g, phase);
+	o.R = R;
+	o.dist = dist;
+	o.phase = phase;
+
+	return true;
+}
+
+void FieldPredictor::predict(const snapshot &s, const sdss::RunGeometry &run, std::vector<Observation> &out) const
+{
+	sdss::RunGeometry g = run;
+	sdss::Mask mask(g);
+	const Radians len = g.length();
+	const Radians nulo = mask.lo(0), nuhi = mask.hi(5);
+
+	// how far a bucketed object may move between the snapshot and the run
+	const double h = std::max(std::fabs(g.tstart - s.t), std::fabs(g.tend - s.t)) + ltmax;
+	const Radians m = 1.25*maxRate*h + slack;
+
+	// cells along the stripe, widened by m. The segments are short enough
+	// for their (great circle) edges to stay within the extra slack of the
+	// constant nu edges of the mask.
+	const Transform gcsequ = Transform::gcsequ(g.node, g.inc);
+	const Transform equgcs = Transform::equgcs(g.node, g.inc);
+	const int nseg = (int)ceil((len + 2.*m) / segLen);
+	const Radians seg = (len + 2.*m) / nseg;
+	const Radians mm = m + (std::max(std::fabs(nulo), std::fabs(nuhi)) + m) * (1. - cos(seg / 2.));
+
+	std::vector<Healpix::range> ranges, tmp;
+	std::vector<V3> vtx(4);
+	for(int k = 0; k != nseg; k++)
+	{
+		const Radians mu0 = g.muStart - m + k*seg, mu1 = mu0 + seg;
+		vtx[0] = gcsequ(unitvec(mu0, nulo - mm));
+		vtx[1] = gcsequ(unitvec(mu1, nulo - mm));
+		vtx[2] = gcsequ(unitvec(mu1, nuhi + mm));
+		vtx[3] = gcsequ(unitvec(mu0, nuhi + mm));
+		hpx.query_polygon(vtx, tmp);
+		ranges.insert(ranges.end(), tmp.begin(), tmp.end());
+	}
+	std::sort(ranges.begin(), ranges.end());
+
+	// candidates: the objects in those cells, and the fast moving ones
+	std::vector<size_t> cand(s.fast);
+	Healpix::pixel done = 0;
+	for(size_t k = 0; k != ranges.size(); k++)
+	{
+		const Healpix::pixel lo = std::max(ranges[k].first, done);
+		if(lo >= ranges[k].second) { continue; }
+		done = ranges[k].second;
+
+		std::vector<std::pair<Healpix::pixel, size_t> >::const_iterator it =
+			std::lower_bound(s.cells.begin(), s.cells.end(), std::make_pair(lo, (size_t)0));
+		for(; it != s.cells.end() && it->first < done; ++it)
+		{
+			cand.push_back(it->second);
+		}
+	}
+
+	// coarse test in (mu, nu), then refinement
+	const size_t at = out.size();
+	size_t nnear = 0;
+	for(size_t k = 0; k != cand.size(); k++)
+	{
+		const size_t i = cand[k];
+		const Radians mi = 1.25*s.rate[i]*h + slack;
+
+		Radians mu, nu;
+		lonlat(equgcs(s.u[i]), mu, nu);
+		if(nu < nulo - mi || nu > nuhi + mi) { continue; }
+
+		Radians mu0 = g.muStart - mi;
+		normalize(mu0);
+		if(distance(mu0, mu) > len + 2.*mi) { continue; }
+
+		nnear++;
+		Observation o;
+		if(refine(i, g, mask, mu, o)) { out.push_back(o); }
+	}
+	std::sort(out.begin() + at, out.end(), earlier());
+
+	DEBUG(verb1) << "Run " << g.run << ": " << cand.size() << " candidates, " << nnear << " refined, " << out.size() - at << " observations";
+}
+
+void FieldPredictor::predict(const std::vector<sdss::RunGeometry> &runs, std::vector<Observation> &out) const
+{
+	// runs by the grid epoch closest to their middle
+	std::vector<std::pair<MJD, size_t> > node(runs.size());
+	for(size_t k = 0; k != runs.size(); k++)
+	{
+		const MJD tmid = (runs[k].tstart + runs[k].tend) / 2.;
+		node[k] = std::make_pair(step * floor(tmid / step + 0.5), k);
+	}
+	std::sort(node.begin(), node.end());
+
+	std::vector<std::vector<Observation> > obs(runs.size());
+	snapshot s;
+	for(size_t k = 0; k != node.size(); k++)
+	{
+		if(k == 0 || node[k].first != node[k-1].first)
+		{
+			take_snapshot(node[k].first, s);
+		}
+		predict(s, runs[node[k].second], obs[node[k].second]);
+	}
+
+	for(size_t k = 0; k != obs.size(); k++)
+	{
+		out.insert(out.end(), obs[k].begin(), obs[k].end());
+	}
+}
+
+void FieldPredictor::predict(const sdss::RunGeometry &run, std::vector<Observation> &out) const
+{
+	predict(std::vector<sdss::RunGeometry>(1, run), out);
+}
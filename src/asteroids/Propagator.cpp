@@ -0,0 +1,281 @@
+//
+// Two-body propagation of orbits.
+//
+// Elliptic orbits are propagated in blocks of objects, each step being a
+// simple loop without data dependent branches: mean anomaly, Kepler's
+// equation (Markley's method), and the conversion of the eccentric anomaly
+// to the position and velocity in the orbital plane, rotated to the frame
+// of the elements by the precomputed orientation vectors P and Q. The few
+// hyperbolic and parabolic orbits are then propagated one by one.
+//
+
+#include <astro/asteroids/propagator.h>
+#include <astro/system/threadpool.h>
+#include <astro/constants.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace peyton;
+using namespace peyton::asteroids;
+
+namespace {
+
+	const size_t BLOCK = 256;
+	const size_t chunkLen = 16384;	// objects per propagation job
+
+	//
+	// Markley's solution of Kepler's equation, for M in [-pi, pi]. Returns
+	// E, along with sin(E) and cos(E).
+	//
+	inline double markley(double M, double e, double &sE, double &cE)
+	{
+		const double pi = ctn::pi, pi2 = ctn::pi * ctn::pi;
+
+		const double m = std::fabs(M);
+		const double ome = 1. - e;
+
+		// starter, from the solution of a cubic
+		const double alpha = (3.*pi2 + 1.6*pi*(pi - m)/(1. + e)) / (pi2 - 6.);
+		const double d = 3.*ome + alpha*e;
+		const double r = 3.*alpha*d*(d - ome)*m + m*m*m;
+		const double q = 2.*alpha*d*ome - m*m;
+		const double q2 = q*q;
+		const double w3 = cbrt(std::fabs(r) + std::sqrt(q2*q + r*r)), w = w3*w3;
+		const double E1 = (2.*r*w/(w*w + w*q + q2) + m) / d;
+
+		// fifth order correction
+		const double s = std::sin(E1), c = std::cos(E1);
+		const double f0 = E1 - e*s - m, f1 = 1. - e*c, f2 = e*s, f3 = 1. - f1;
+		const double d3 = -f0 / (f1 - 0.5*f0*f2/f1);
+		const double d4 = -f0 / (f1 + 0.5*d3*f2 + d3*d3*f3/6.);
+		const double d5 = -f0 / (f1 + 0.5*d4*f2 + d4*d4*f3/6. - d4*d4*d4*f2/24.);
+
+		// sin and cos of the (small) correction, and of E = E1 + d5
+		const double dd = d5*d5;
+		const double sd = d5*(1. - dd/6.*(1. - dd/20.*(1. - dd/42.*(1. - dd/72.))));
+		const double cd = 1. - dd/2.*(1. - dd/12.*(1. - dd/30.*(1. - dd/56.)));
+		sE = copysign(s*cd + c*sd, M);
+		cE = c*cd - s*sd;
+
+		return copysign(E1 + d5, M);
+	}
+
+	// reduce M to [-pi, pi)
+	inline double reduce(double M)
+	{
+		return M - ctn::pi2 * std::floor((M + ctn::pi) / ctn::pi2);
+	}
+
+}
+
+Radians peyton::asteroids::kepler(Radians M, double e)
+{
+	double E;
+	kepler(&M, &e, &E, 1);
+	return E;
+}
+
+void peyton::asteroids::kepler(const double *M, const double *e, double *E, size_t n)
+{
+	for(size_t i = 0; i != n; i++)
+	{
+		double s, c;
+		const double m = reduce(M[i]);
+		E[i] = markley(m, e[i], s, c) + (M[i] - m);
+	}
+}
+
+Propagator::Propagator(const std::vector<Asteroid> &obj, int nthreads_)
+	: nthreads(nthreads_ > 0 ? nthreads_ : system::ThreadPool::hardware_concurrency())
+{
+	init(obj.empty() ? NULL : &obj[0], obj.size());
+}
+
+Propagator::Propagator(const Asteroid *obj, size_t n_, int nthreads_)
+	: nthreads(nthreads_ > 0 ? nthreads_ : system::ThreadPool::hardware_concurrency())
+{
+	init(obj, n_);
+}
+
+void Propagator::init(const Asteroid *obj, size_t n_)
+{
+	n = n_;
+	a.resize(n); e.resize(n); ek.resize(n); b.resize(n);
+	nn.resize(n); M0.resize(n); t0.resize(n);
+	for(int k = 0; k != 3; k++) { P[k].resize(n); Q[k].resize(n); }
+
+	for(size_t i = 0; i != n; i++)
+	{
+		const double *el = obj[i].elements;
+		const double ecc = el[1];
+		const double ax = std::fabs(el[0]);
+
+		a[i] = ax;
+		e[i] = ecc;
+		ek[i] = ecc < 1. ? ecc : 0.;
+		b[i] = ax * std::sqrt(std::fabs(1. - ecc*ecc));
+		nn[i] = ecc == 1. ? ctn::gk / std::sqrt(2.*ax*ax*ax) : ctn::gk / (ax*std::sqrt(ax));
+		M0[i] = el[5];
+		t0[i] = obj[i].t0;
+		if(ecc >= 1.) { open.push_back(i); }
+
+		// orientation of the orbit
+		const double ci = cos(el[2]), si = sin(el[2]);
+		const double cn = cos(el[3]), sn = sin(el[3]);
+		const double cw = cos(el[4]), sw = sin(el[4]);
+		P[0][i] =  cw*cn - sw*sn*ci;	Q[0][i] = -sw*cn - cw*sn*ci;
+		P[1][i] =  cw*sn + sw*cn*ci;	Q[1][i] = -sw*sn + cw*cn*ci;
+		P[2][i] =  sw*si;		Q[2][i] =  cw*si;
+	}
+}
+
+void Propagator::propagate(MJD t, size_t from, size_t to, double *r, double *v, size_t stride) const
+{
+	double x[BLOCK], y[BLOCK], vx[BLOCK], vy[BLOCK];
+
+	for(size_t at = from; at < to; at += BLOCK)
+	{
+		const size_t len = std::min(BLOCK, to - at);
+
+		// position and velocity in the orbital plane
+		for(size_t k = 0; k != len; k++)
+		{
+			const size_t i = at + k;
+			double s, c;
+			markley(reduce(M0[i] + nn[i] * (t - t0[i])), ek[i], s, c);
+
+			const double f = nn[i] / (1. - ek[i]*c);
+			x[k] = a[i] * (c - ek[i]);
+			y[k] = b[i] * s;
+			vx[k] = -a[i] * f * s;
+			vy[k] = b[i] * f * c;
+		}
+
+		// rotate to the frame of the elements
+		for(size_t k = 0; k != len; k++)
+		{
+			const size_t i = at + k;
+			double *ri = r + i*stride;
+			ri[0] = x[k]*P[0][i] + y[k]*Q[0][i];
+			ri[1] = x[k]*P[1][i] + y[k]*Q[1][i];
+			ri[2] = x[k]*P[2][i] + y[k]*Q[2][i];
+		}
+		if(v != NULL)
+		{
+			for(size_t k = 0; k != len; k++)
+			{
+				const size_t i = at + k;
+				double *vi = v + i*stride;
+				vi[0] = vx[k]*P[0][i] + vy[k]*Q[0][i];
+				vi[1] = vx[k]*P[1][i] + vy[k]*Q[1][i];
+				vi[2] = vx[k]*P[2][i] + vy[k]*Q[2][i];
+			}
+		}
+	}
+
+	// hyperbolic and parabolic orbits
+	std::vector<size_t>::const_iterator it = std::lower_bound(open.begin(), open.end(), from);
+	for(; it != open.end() && *it < to; ++it)
+	{
+		const size_t i = *it;
+		double vi[3];
+		propagate_open(i, t, r + i*stride, v != NULL ? v + i*stride : vi);
+	}
+}
+
+void Propagator::propagate_open(size_t i, MJD t, double r[3], double v[3]) const
+{
+	const double M = M0[i] + nn[i] * (t - t0[i]);
+	double x, y, vx, vy;
+
+	if(e[i] == 1.)
+	{
+		// Barker's equation, s + s^3/3 = M, s = tan(nu/2)
+		const double q = a[i];
+		const double s = 2.*sinh(asinh(1.5*M)/3.);
+		const double sdot = nn[i] / (1. + s*s);
+		x = q * (1. - s*s);
+		y = 2.*q*s;
+		vx = -2.*q*s*sdot;
+		vy = 2.*q*sdot;
+	}
+	else
+	{
+		// e sinh H - H = M, by Newton's method
+		const double ecc = e[i];
+		double H = M == 0. ? 0. : copysign(log(2.*std::fabs(M)/ecc + 1.8), M);
+		for(int k = 0; k != 100; k++)
+		{
+			const double dH = (ecc*sinh(H) - H - M) / (ecc*cosh(H) - 1.);
+			H -= dH;
+			if(std::fabs(dH) <= 1e-15 * (1. + std::fabs(H))) { break; }
+		}
+
+		const double sh = sinh(H), ch = cosh(H);
+		const double f = nn[i] / (ecc*ch - 1.);
+		x = a[i] * (ecc - ch);
+		y = b[i] * sh;
+		vx = -a[i] * f * sh;
+		vy = b[i] * f * ch;
+	}
+
+	for(int k = 0; k != 3; k++)
+	{
+		r[k] = x*P[k][i] + y*Q[k][i];
+		v[k] = vx*P[k][i] + vy*Q[k][i];
+	}
+}
+
+//
+// Propagate all objects to epochs t, storing object i at epoch t[j] at
+// r + j*estride + i*stride, in jobs of up to chunkLen objects at one epoch.
+//
+void Propagator::run(const MJD *t, size_t nt, double *r, double *v, size_t stride, size_t estride) const
+{
+	const size_t nchunks = (n + chunkLen - 1) / chunkLen;
+	if(nthreads == 1 || nchunks * nt <= 1)
+	{
+		for(size_t j = 0; j != nt; j++)
+		{
+			propagate(t[j], 0, n, r + j*estride, v != NULL ? v + j*estride : NULL, stride);
+		}
+		return;
+	}
+
+	system::ThreadPool pool(nthreads);
+	for(size_t j = 0; j != nt; j++)
+	{
+		for(size_t from = 0; from < n; from += chunkLen)
+		{
+			pool.submit(boost::bind(&Propagator::propagate, this, t[j], from, std::min(n, from + chunkLen),
+				r + j*estride, v != NULL ? v + j*estride : (double *)NULL, stride));
+		}
+	}
+	pool.wait();
+}
+
+void Propagator::operator()(size_t i, MJD t, math::V3 &r, math::V3 &v) const
+{
+	if(e[i] >= 1.)
+	{
+		propagate_open(i, t, &r.x, &v.x);
+		return;
+	}
+
+	// with stride 0, object i is stored at r itself
+	propagate(t, i, i + 1, &r.x, &v.x, 0);
+}
+
+void Propagator::operator()(MJD t, math::V3 *r, math::V3 *v) const
+{
+	(*this)(&t, 1, r, v);
+}
+
+void Propagator::operator()(const MJD *t, size_t nt, math::V3 *r, math::V3 *v) const
+{
+	const size_t stride = sizeof(math::V3) / sizeof(double);
+	run(t, nt, &r[0].x, v != NULL ? &v[0].x : NULL, stride, n * stride);
+}
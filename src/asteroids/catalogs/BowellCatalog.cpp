@@ -2,29 +2,37 @@
 #include <astro/time.h>
 #include <astro/exceptions.h>
 #include <astro/system/log.h>
+#include <astro/io/parse.h>
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "BowellCatalog.h"
+#include "RecordReader.h"
 
 using namespace peyton;
 using namespace peyton::exceptions;
 using namespace peyton::asteroids;
 
 bool BowellCatalog::openCatalog(const char *filename, const char *mode) {
-	fp = fopen(filename, "rb");
-	if(fp == NULL) { DEBUG(verb1) << "Error opening catalog [" << filename << "]"; return false; }
+	fd = ::open(filename, O_RDONLY);
+	if(fd == -1) { DEBUG(verb1) << "Error opening catalog [" << filename << "]"; return false; }
 
-	fseek(fp, 0, SEEK_END);
-	int size = ftell(fp);
+	off_t size = lseek(fd, 0, SEEK_END);
 	if(size % BowellCatalog::recordByteLen != 0) {
-		fclose(fp); fp = NULL;
 		DEBUG(verb1) << "Size of catalog not a multiple of record length";
 		return false;
 	}
 
 	recordCnt = size / BowellCatalog::recordByteLen;
+	reader.open(filename, recordByteLen, boost::bind(&BowellCatalog::parseRecord, this, _1, _2));
 	
 	return true;
 }
@@ -47,53 +55,38 @@ int BowellCatalog::read(Asteroid &obj, const char *name)
 	return -1;
 }
 
-int BowellCatalog::read(Asteroid &obj, const int id)
+//
+// Parse a single fixed-width record. Fields are converted in the manner of
+// atof()/atoi() (that is, blank fields are zero).
+//
+bool BowellCatalog::parseRecord(Asteroid &obj, const char *buf) const
 {
-	if(id != -1) {
-		fseek(fp, id*recordByteLen, SEEK_SET);
-	}
-
-	int y, m, d;
-	char buffers[14][20];
-	int blimits[14] = {5, 18, 5, 5, 5, 4, 2, 2, 10, 10, 10, 10, 10, 12};
+	using namespace peyton::io;
 
-	// load record
-	char buf[recordByteLen];
-	fread(buf, recordByteLen, 1, fp);
-
-	// parse record
-	int ret = sscanf(buf, "%5c%*c%18c%*17c%5c%*c%5c%*42c%5c%*6c%4c%2c%2c%*c%10c%*c%10c%*c%10c%10c%*c%10c%*c%12c",
-		buffers[0], buffers[1],
-		buffers[2], buffers[3],
-		buffers[4],
-		buffers[5], buffers[6],	buffers[7],
-		buffers[8], buffers[9],	buffers[10], buffers[11], buffers[12], buffers[13]
-		);
-
-	if(ret != 14) {
-		DEBUG(verb1) << "Error reading asteroid record";
-		return -1;
+	if(buf[recordByteLen-1] != '\n') {
+		return false;
 	}
 
-	// fixups
-	int i;
-	for(i = 0; i != 14; i++) buffers[i][blimits[i]] = 0;
-
-	obj.numeration = std::atoi(buffers[0]);
+	obj.numeration = parse::atoi(buf, buf + 5);
 	obj.type = 0; // ASTORB contains only asteroids
 
-	for(i = Asteroid::maxNameLen-1; i != -1 && buffers[1][i] == ' '; i--);
-	buffers[1][i+1] = 0;
-	strcpy(obj.name, buffers[1]);
-	obj.id = id == -1 ? ftell(fp)/recordByteLen - 1 : id;
-
-	obj.h = atof(buffers[2]); obj.g = atof(buffers[3]);
-	obj.arc = atoi(buffers[4]);
-	y = atoi(buffers[5]);
-	m = atoi(buffers[6]);
-	d = atoi(buffers[7]);
-
-	for(i = 0; i != 6; i++) obj.elements[i] = atof(buffers[13-i]);
+	int i;
+	for(i = Asteroid::maxNameLen-1; i != -1 && buf[6+i] == ' '; i--);
+	memcpy(obj.name, buf + 6, i+1);
+	obj.name[i+1] = 0;
+
+	obj.h = parse::atof(buf + 41, buf + 46); obj.g = parse::atof(buf + 47, buf + 52);
+	obj.arc = parse::atoi(buf + 94, buf + 99);
+	int y = parse::atoi(buf + 105, buf + 109);
+	int m = parse::atoi(buf + 109, buf + 111);
+	int d = parse::atoi(buf + 111, buf + 113);
+
+	obj.elements[5] = parse::atof(buf + 114, buf + 124);
+	obj.elements[4] = parse::atof(buf + 125, buf + 135);
+	obj.elements[3] = parse::atof(buf + 136, buf + 146);
+	obj.elements[2] = parse::atof(buf + 146, buf + 156);
+	obj.elements[1] = parse::atof(buf + 157, buf + 167);
+	obj.elements[0] = parse::atof(buf + 168, buf + 180);
 
 	// conversions
 	obj.t0 = peyton::time::calToMJD(y, m, d, 0);
@@ -103,36 +96,70 @@ int BowellCatalog::read(Asteroid &obj, const int id)
 	obj.elements[3] *= ctn::d2r;
 	obj.elements[2] *= ctn::d2r;
 
+	return true;
+}
+
+int BowellCatalog::readAt(Asteroid &obj, int id) const
+{
+	if(id < 0 || id >= recordCnt) { return -1; }
+
+	// load record
+	char buf[recordByteLen];
+	if(!readFully(fd, buf, recordByteLen, (off_t)id*recordByteLen) || !parseRecord(obj, buf)) {
+		DEBUG(verb1) << "Error reading asteroid record";
+		return -1;
+	}
+
+	obj.id = id;
+
 	return 0;
 }
 
-int BowellCatalog::read(std::vector<Asteroid> &aobj, const int from_in, const int to_in)
+// smallest read worth parsing in parallel
+static const int parallelReadLen = 4096;
+
+int BowellCatalog::readAt(std::vector<Asteroid> &aobj, int from, int to) const
 {
-	int from = from_in, to = to_in;
 	if(to > recordCnt) {
 		to = recordCnt;
 	}
+	if(from < 0 || from >= to) { aobj.clear(); return 0; }
+
+	// large reads are parsed in parallel, straight from the mapped file
+	if(to - from >= parallelReadLen) {
+		int n = reader.read(aobj, from, to);
+		if(n != -1) { return n; }
+	}
 
 	aobj.erase(aobj.begin(), aobj.end());
 	aobj.resize(to - from);
 	int cnt = 0;
 
-	// locate first record
-	fseek(fp, from*recordByteLen, SEEK_SET);
-
+	// read in blocks of records
+	const int blockLen = 1024;
+	std::vector<char> buf(blockLen*recordByteLen);
 	while(cnt != to - from) {
-		Asteroid &obj = aobj[cnt];
-
-		read(obj, -1);
-
-		cnt++;
+		int n = std::min(blockLen, to - from - cnt);
+		if(!readFully(fd, &buf[0], (size_t)n*recordByteLen, (off_t)(from + cnt)*recordByteLen)) {
+			DEBUG(verb1) << "Error reading asteroid records";
+			aobj.resize(cnt);
+			break;
+		}
+
+		for(int i = 0; i != n; i++, cnt++) {
+			Asteroid &obj = aobj[cnt];
+			if(!parseRecord(obj, &buf[i*recordByteLen])) {
+				DEBUG(verb1) << "Error parsing asteroid record " << from + cnt;
+			}
+			obj.id = from + cnt;
+		}
 	}
 
 	return cnt;
 }
 
-int BowellCatalog::recordCount() { return recordCnt; }
+int BowellCatalog::recordCount() const { return recordCnt; }
 
 BowellCatalog::~BowellCatalog() {
-	if(fp != NULL) fclose(fp);
+	if(fd != -1) ::close(fd);
 }
@@ -3,6 +3,10 @@
 
 #include <astro/asteroids/catalog.h>
 
+#include "RecordReader.h"
+
+#include <string>
+
 namespace peyton {
 namespace asteroids {
 
@@ -11,15 +15,20 @@ protected:
 	enum {recordByteLen = 266 + 1 };
 	int recordCnt;
 	virtual bool openCatalog(const char *filename, const char *mode);
-	FILE *fp;
+	int fd;			///< read with pread()
+	mutable RecordReader reader;	///< parses large ranges of records in parallel
+
+	bool parseRecord(Asteroid &obj, const char *buf) const;
 
 public:
-	MPCCatalog() { fp = NULL; recordCnt = -1; }
+	MPCCatalog() { fd = -1; recordCnt = -1; }
+
+	virtual int readAt(Asteroid &obj, int id) const;
+	virtual int readAt(std::vector<Asteroid> &obj, int from, int to) const;
+	virtual int recordCount() const;
 
+	using Catalog::read;
 	virtual int read(Asteroid &obj, const char *name);
-	virtual int read(std::vector<Asteroid> &obj, const int from, const int to);
-	virtual int read(Asteroid &obj, const int id);
-	virtual int recordCount();
 
 	virtual int write(Asteroid &obj, int at);
 
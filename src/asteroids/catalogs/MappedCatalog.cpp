@@ -0,0 +1,111 @@
+#include <astro/system/log.h>
+#include <astro/exceptions.h>
+
+#include <cstring>
+#include <climits>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "MappedCatalog.h"
+
+using namespace peyton::asteroids;
+using namespace peyton::exceptions;
+
+bool MappedCatalog::openCatalog(const char *filename, const char *mode)
+{
+	if(strcmp(mode, "r")) { DEBUG(verb1) << "Memory mapped catalogs are read-only"; return false; }
+
+	struct stat buf;
+	if(stat(filename, &buf) == -1) { DEBUG(verb1) << "Error opening catalog"; return false; }
+
+	if(buf.st_size % sizeof(Asteroid) != 0) {
+		DEBUG(verb1) << "Size of catalog not a multiple of record length";
+		return false;
+	}
+
+	// MemoryMap takes the length of the mapping as an int
+	if(buf.st_size > INT_MAX) {
+		DEBUG(verb1) << "Catalog too large to be memory mapped (" << buf.st_size << " bytes)";
+		return false;
+	}
+
+	this->filename = filename;
+	recordCnt = buf.st_size / sizeof(Asteroid);
+	if(recordCnt == 0) { return true; }
+
+	try {
+		recs.open(filename, recordCnt);
+	} catch(EIOException &e) {
+		DEBUG(verb1) << "Error mapping catalog: " << e.info;
+		return false;
+	}
+
+	return true;
+}
+
+void MappedCatalog::index()
+{
+	if(names.load(filename)) { return; }
+
+	for(int i = 0; i != recordCnt; i++) {
+		names.add(recs[i]);
+	}
+	names.build();
+	names.save(filename);
+}
+
+int MappedCatalog::read(Asteroid &obj, const char *name)
+{
+	if(!names.ready()) { index(); }
+
+	int id = names.find(name);
+	if(id == -1) return -1;
+
+	return read(obj, id);
+}
+
+int MappedCatalog::readAt(Asteroid &obj, int id) const
+{
+	if(id < 0 || id >= recordCnt) { return -1; }
+
+	obj = recs[id];
+	return 0;
+}
+
+int MappedCatalog::readAt(std::vector<Asteroid> &obj, int from, int to) const
+{
+	if(to > recordCnt) { to = recordCnt; }
+	if(from < 0 || from >= to) { obj.clear(); return 0; }
+
+	obj.assign(&recs[from], &recs[from] + (to - from));
+
+	return to - from;
+}
+
+int MappedCatalog::readAt(std::vector<Asteroid> &obj, const int *ids, int num) const
+{
+	// ids out of range come back as empty records, not as stale ones
+	obj.erase(obj.begin(), obj.end());
+	obj.resize(num);
+	for(int i = 0; i != num; i++) {
+		readAt(obj[i], ids[i]);
+	}
+
+	return num;
+}
+
+int MappedCatalog::recordCount() const { return recordCnt; }
+
+const Asteroid *MappedCatalog::records() { return recordCnt ? &recs[0] : NULL; }
+
+int MappedCatalog::write(Asteroid &, int)
+{
+	DEBUG(verb1) << "Memory mapped catalogs are read-only";
+	return 0;
+}
+
+char *MappedCatalog::identify(char *name) {
+	strcpy(name, "NATIVE-MMAP");
+	return name;
+}
@@ -0,0 +1,56 @@
+#ifndef _astro_mappedcatalog_h
+#define _astro_mappedcatalog_h
+
+#include <astro/asteroids/catalog.h>
+#include <astro/system/memorymap.h>
+
+#include "NameIndex.h"
+
+#include <string>
+
+namespace peyton {
+namespace asteroids {
+
+/**
+	\brief Memory mapped, read-only catalog in NATIVE format
+
+	The catalog file is mapped into memory, and records are read in place:
+	reading a record or a range of records is a memcpy, and records() gives
+	direct access to all of them, without any copying. The name index is
+	only loaded (or built) on the first lookup by name.
+*/
+class MappedCatalog : public Catalog {
+protected:
+	system::MemoryMapVector<Asteroid> recs;
+	int recordCnt;
+
+	std::string filename;
+	NameIndex names;	///< loaded or built on first lookup by name
+
+	virtual bool openCatalog(const char *filename, const char *mode);
+	void index();
+
+	friend class Catalog;
+public:
+	MappedCatalog() : recordCnt(0) {}
+
+	virtual int readAt(Asteroid &obj, int id) const;
+	virtual int readAt(std::vector<Asteroid> &obj, int from, int to) const;
+	virtual int readAt(std::vector<Asteroid> &obj, const int *ids, int num) const;
+	virtual int recordCount() const;
+
+	using Catalog::read;
+	virtual int read(Asteroid &obj, const char *name);
+
+	virtual const Asteroid *records();
+
+	virtual int write(Asteroid &obj, int at);
+
+	virtual char *identify(char *);
+
+};
+
+}
+}
+
+#endif
@@ -19,10 +19,8 @@ bool MemoryCatalog::openCatalog(const char *filename, const char *mode)
 {
 	mcat *cat = (mcat *)filename;
 	if(!strcmp(mode, "r")) {
-		// read mode
-		fp = fmemopen(cat->first, cat->second, "rb");
-		if(fp == NULL) { DEBUG(verb1) << "Error opening memory catalog"; return false; }
-
+		// read mode, straight from memory
+		mem = cat->first;
 		return initialize(cat->second);
 	} else if(!strcmp(mode, "w")) {
 		// write mode -- TODO: this should use open_memstream?
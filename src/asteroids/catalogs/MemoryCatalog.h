@@ -12,7 +12,8 @@
 		struct { int length; char *contents };
 
 	where length is the length of the contents which contains the file
-	data. fmemopen is then used to emulate FILE* access to that location.
+	data. Records are read straight from that location; for writing,
+	fmemopen is used to emulate FILE* access to it.
 */
 
 #if defined(HAVE_FMEMOPEN)
@@ -0,0 +1,140 @@
+#include <astro/system/log.h>
+#include <astro/exceptions.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "NameIndex.h"
+
+using namespace peyton::asteroids;
+using namespace peyton::exceptions;
+
+static const char magic[8] = { 'N', 'A', 'M', 'E', 'I', 'D', 'X', '1' };
+
+namespace {
+
+	inline long long mtime(const struct stat &st)
+	{
+		return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	}
+
+	inline bool less_entry(const NameIndex::entry &a, const NameIndex::entry &b)
+	{
+		return memcmp(a.name, b.name, sizeof(a.name)) < 0;
+	}
+
+	inline bool same_entry(const NameIndex::entry &a, const NameIndex::entry &b)
+	{
+		return memcmp(a.name, b.name, sizeof(a.name)) == 0;
+	}
+
+}
+
+void NameIndex::key(char *out, const char *name)
+{
+	memset(out, 0, sizeof(((entry *)0)->name));
+	strncpy(out, name, Asteroid::maxNameLen + 1);
+	for(int l = strlen(out); l > 0; l--) { if(out[l] == ' ') out[l] = '_'; }
+}
+
+bool NameIndex::load(const std::string &catfn)
+{
+	struct stat cst, ist;
+	const std::string fn = indexFile(catfn);
+	if(stat(catfn.c_str(), &cst) == -1 || stat(fn.c_str(), &ist) == -1) { return false; }
+	if(ist.st_size < (off_t)sizeof(header)) { return false; }
+
+	try {
+		map.open(fn, ist.st_size);
+	} catch(EIOException &e) {
+		DEBUG(verb1) << "Error mapping name index: " << e.info;
+		return false;
+	}
+
+	const header &h = *(const header *)(void *)map;
+	if(memcmp(h.magic, magic, sizeof(magic)) ||
+		h.count < 0 || ist.st_size != (off_t)(sizeof(header) + h.count * sizeof(entry)) ||
+		h.catsize != cst.st_size || h.catmtime != mtime(cst))
+	{
+		DEBUG(verb1) << "Name index " << fn << " is stale, ignoring it";
+		map.close();
+		return false;
+	}
+
+	entries = (const entry *)((const char *)(void *)map + sizeof(header));
+	cnt = h.count;
+	loaded = true;
+
+	return true;
+}
+
+void NameIndex::add(const Asteroid &a)
+{
+	entry e;
+	key(e.name, a.name);
+	e.id = a.id;
+	mem.push_back(e);
+}
+
+void NameIndex::build()
+{
+	// sort by name, keeping the last record of those with the same name
+	std::reverse(mem.begin(), mem.end());
+	std::stable_sort(mem.begin(), mem.end(), less_entry);
+	mem.erase(std::unique(mem.begin(), mem.end(), same_entry), mem.end());
+
+	entries = mem.empty() ? NULL : &mem[0];
+	cnt = mem.size();
+	loaded = true;
+}
+
+bool NameIndex::save(const std::string &catfn) const
+{
+	struct stat cst;
+	if(stat(catfn.c_str(), &cst) == -1) { return false; }
+
+	header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, magic, sizeof(magic));
+	h.count = cnt;
+	h.catsize = cst.st_size;
+	h.catmtime = mtime(cst);
+
+	// write to a temporary file, and move it into place
+	const std::string fn = indexFile(catfn);
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s.%d", fn.c_str(), (int)getpid());
+
+	FILE *fp = fopen(tmp, "wb");
+	if(fp == NULL) { DEBUG(verb1) << "Cannot write name index " << fn; return false; }
+
+	bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+		(cnt == 0 || fwrite(entries, sizeof(entry), cnt, fp) == (size_t)cnt);
+	ok = (fclose(fp) == 0) && ok;
+	if(!ok || rename(tmp, fn.c_str()) != 0) {
+		DEBUG(verb1) << "Error writing name index " << fn;
+		unlink(tmp);
+		return false;
+	}
+
+	return true;
+}
+
+int NameIndex::find(const char *name) const
+{
+	if(strlen(name) > Asteroid::maxNameLen + 1) { return -1; }
+
+	entry e;
+	memset(e.name, 0, sizeof(e.name));
+	strcpy(e.name, name);
+
+	const entry *i = std::lower_bound(entries, entries + cnt, e, less_entry);
+	if(i == entries + cnt || !same_entry(*i, e)) { return -1; }
+
+	return i->id;
+}
@@ -0,0 +1,71 @@
+#ifndef _astro_nameindex_h
+#define _astro_nameindex_h
+
+#include <astro/asteroids/asteroid.h>
+#include <astro/system/memorymap.h>
+
+#include <string>
+#include <vector>
+
+namespace peyton {
+namespace asteroids {
+
+/**
+	\brief Name to id index of an asteroid catalog
+
+	Names (with spaces replaced by underscores) are kept sorted, and looked
+	up by binary search. The index of a catalog file is stored next to it,
+	in <catalog>.names, and memory mapped when the catalog is reopened, so
+	that it is built only once. A stored index is used only if the size and
+	modification time of the catalog match those it was built for.
+*/
+class NameIndex {
+public:
+	struct entry {
+		char name[Asteroid::maxNameLen + 2];	///< zero padded
+		int id;
+	};
+
+protected:
+	struct header {
+		char magic[8];
+		int count;
+		int reserved;
+		long long catsize;	///< size of the catalog file
+		long long catmtime;	///< modification time of the catalog file, in ns
+	};
+
+	system::MemoryMap map;		///< mapped index file, or
+	std::vector<entry> mem;		///< in-memory index
+	const entry *entries;
+	int cnt;
+	bool loaded;
+
+	static std::string indexFile(const std::string &catfn) { return catfn + ".names"; }
+public:
+	NameIndex() : entries(NULL), cnt(0), loaded(false) {}
+
+	/// true if load() or build() has been called successfully
+	bool ready() const { return loaded; }
+
+	/// map the stored index of catalog \a catfn. Returns false if there is none, or if it is stale.
+	bool load(const std::string &catfn);
+	/// build the index from (name, id) pairs, added with add()
+	void build();
+	/// add a record to the index being built
+	void add(const Asteroid &a);
+	/// store the index built by build() next to catalog \a catfn. Returns false on failure.
+	bool save(const std::string &catfn) const;
+
+	/// id of asteroid \a name, or -1 if there is none
+	int find(const char *name) const;
+	int size() const { return cnt; }
+
+	/// the index key of \a name: spaces after the first character replaced by underscores, zero padded
+	static void key(char *out, const char *name);
+};
+
+}
+}
+
+#endif
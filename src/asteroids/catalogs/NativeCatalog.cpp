@@ -2,46 +2,52 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "NativeCatalog.h"
+#include "RecordReader.h"
 
 using namespace peyton::asteroids;
 
-inline char * underscore(char *c) {
-	int l = strlen(c);
-	while(l) { if(c[l] == ' ') c[l] = '_'; l--; }
-	return c;
-}
-
 bool NativeCatalog::initialize(size_t size)
 {
 	if(size % recordByteLen != 0) {
-		fclose(fp); fp = NULL;
 		DEBUG(verb1) << "Size of catalog not a multiple of record length";
 		return false;
 	}
 
 	recordCnt = size / recordByteLen;
+	return true;
+}
 
-	// construct a name/id map
-	Asteroid a;
-	for(int i = 0; i != recordCnt; i++) {
-		read(a, -1);
-		names[underscore(strdup(a.name))] = a.id;
+void NativeCatalog::index()
+{
+	if(!filename.empty() && names.load(filename)) { return; }
+
+	// construct a name/id index, and store it for next time
+	const int blockLen = 4096;
+	std::vector<Asteroid> a;
+	for(int i = 0; i < recordCnt; i += blockLen) {
+		int n = readAt(a, i, i + blockLen);
+		for(int j = 0; j < n; j++) { names.add(a[j]); }
 	}
-	return true;
+	names.build();
+
+	if(!filename.empty()) { names.save(filename); }
 }
 
 bool NativeCatalog::openCatalog(const char *filename, const char *mode)
 {
 	if(!strcmp(mode, "r")) {
 		// read mode
-		fp = fopen(filename, "rb");
-		if(fp == NULL) { DEBUG(verb1) << "Error opening catalog"; return false; }
+		fd = ::open(filename, O_RDONLY);
+		if(fd == -1) { DEBUG(verb1) << "Error opening catalog"; return false; }
 
-		fseek(fp, 0, SEEK_END);
-		size_t size = ftell(fp);
-		fseek(fp, 0, SEEK_SET);
+		off_t size = lseek(fd, 0, SEEK_END);
+		this->filename = filename;
 		return initialize(size);
 	} else if(!strcmp(mode, "w")) {
 		// write mode
@@ -67,55 +73,54 @@ char *NativeCatalog::identify(char *name) {
 
 int NativeCatalog::read(Asteroid &obj, const char *name)
 {
-	NameMap::iterator i = names.find(name);
-	if(i == names.end()) return -1;
+	if(!names.ready()) { index(); }
+
+	int id = names.find(name);
+	if(id == -1) return -1;
 	
-	return read(obj, (*i).second);
+	return read(obj, id);
 }
 
-int NativeCatalog::read(Asteroid &obj, const int id)
+int NativeCatalog::readAt(Asteroid &obj, int id) const
 {
-	if(id != -1) {
-		fseek(fp, id*recordByteLen, SEEK_SET);
-	}
+	if(id < 0 || id >= recordCnt) { return -1; }
 
-	fread(&obj, recordByteLen, 1, fp);
+	if(mem != NULL) {
+		memcpy((void *)&obj, mem + (size_t)id*recordByteLen, recordByteLen);	// mem need not be aligned
+	} else if(!readFully(fd, &obj, recordByteLen, (off_t)id*recordByteLen)) {
+		DEBUG(verb1) << "Error reading asteroid record";
+		return -1;
+	}
 
 	return 0;
 }
 
-int NativeCatalog::read(std::vector<Asteroid> &aobj, const int from_in, const int to_in)
+int NativeCatalog::readAt(std::vector<Asteroid> &aobj, int from, int to) const
 {
-	int from = from_in, to = to_in;
 	if(to > recordCnt) {
 		to = recordCnt;
 	}
 
 	aobj.erase(aobj.begin(), aobj.end());
+	if(from < 0 || from >= to) { return 0; }
 	aobj.resize(to - from);
-	int cnt = 0;
 
-	// locate first record
-	fseek(fp, from*recordByteLen, SEEK_SET);
-
-	while(cnt != to - from) {
-		Asteroid &obj = aobj[cnt];
-
-		read(obj, -1);
-
-		cnt++;
+	// records are stored as they are in memory, so read them in one go
+	const size_t len = (size_t)(to - from)*recordByteLen;
+	if(mem != NULL) {
+		memcpy((void *)&aobj[0], mem + (size_t)from*recordByteLen, len);
+	} else if(!readFully(fd, &aobj[0], len, (off_t)from*recordByteLen)) {
+		DEBUG(verb1) << "Error reading asteroid records";
+		aobj.clear();
+		return -1;
 	}
 
-	return cnt;
+	return to - from;
 }
 
-int NativeCatalog::recordCount() { return recordCnt; }
+int NativeCatalog::recordCount() const { return recordCnt; }
 
 NativeCatalog::~NativeCatalog() {
 	if(fp != NULL) fclose(fp);
-	while(names.size()) {
-		const char *c = (*names.begin()).first;
-		names.erase(names.begin());
-		free((char *)c);
-	}
+	if(fd != -1) ::close(fd);
 }
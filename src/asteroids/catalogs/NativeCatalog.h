@@ -3,39 +3,39 @@
 
 #include <astro/asteroids/catalog.h>
 
-#include <map>
+#include <cstdio>
+#include <string>
 
-#pragma warning(disable: 4786)
+#include "NameIndex.h"
 
 namespace peyton {
 namespace asteroids {
 
-struct less_str : public std::binary_function<char *, char *, bool> {
-	bool operator()(const char *x, const char *y) const {
-		return strcmp(x, y) < 0;
-	}
-};
-
 class NativeCatalog : public Catalog {
 protected:
 	enum {recordByteLen = sizeof(Asteroid)};
 	int recordCnt;
 	virtual bool openCatalog(const char *filename, const char *mode);
-	FILE *fp;
+	FILE *fp;		///< for writing
+	int fd;			///< for reading, with pread()
+	const char *mem;	///< catalog contents, for catalogs in memory
 
-	typedef std::map<const char *, int, less_str> NameMap;
-	NameMap names;
+	std::string filename;	///< catalog file, if any
+	NameIndex names;	///< loaded or built on first lookup by name
 
 	friend class Catalog;
 	
 	bool initialize(size_t size);
+	void index();
 public:
-	NativeCatalog() { fp = NULL; }
+	NativeCatalog() { fp = NULL; fd = -1; mem = NULL; recordCnt = 0; }
+
+	virtual int readAt(Asteroid &obj, int id) const;
+	virtual int readAt(std::vector<Asteroid> &obj, int from, int to) const;
+	virtual int recordCount() const;
 
+	using Catalog::read;
 	virtual int read(Asteroid &obj, const char *name);
-	virtual int read(std::vector<Asteroid> &obj, const int from, const int to);
-	virtual int read(Asteroid &obj, const int id);
-	virtual int recordCount();
 
 	virtual int write(Asteroid &obj, int at);
 
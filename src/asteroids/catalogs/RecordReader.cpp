@@ -0,0 +1,128 @@
+#include <astro/system/log.h>
+#include <astro/exceptions.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <climits>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "RecordReader.h"
+
+using namespace peyton;
+using namespace peyton::exceptions;
+using namespace peyton::asteroids;
+
+namespace {
+
+	const int chunkLen = 16384;	// records per parsing job
+
+	void parseChunk(const record_parser *parse, const char *data, int recordByteLen, Asteroid *out, int from, int n, std::vector<int> *bad)
+	{
+		for(int i = 0; i != n; i++) {
+			Asteroid &obj = out[i];
+			if(!(*parse)(obj, data + (size_t)i * recordByteLen)) {
+				bad->push_back(from + i);
+			}
+			obj.id = from + i;
+		}
+	}
+
+}
+
+void RecordReader::open(const std::string &filename_, int recordByteLen_, const record_parser &parse_)
+{
+	boost::mutex::scoped_lock l(lock);
+
+	filename = filename_;
+	recordByteLen = recordByteLen_;
+	parse = parse_;
+
+	map.close();
+	pool.reset();
+	tried = false;
+}
+
+//
+// Map the whole file and start the pool, on the first read. Returns false
+// if the file cannot be mapped. Must be called with the lock held.
+//
+bool RecordReader::init()
+{
+	if(tried) { return (void *)map != NULL; }
+	tried = true;
+
+	struct stat sb;
+	if(stat(filename.c_str(), &sb) == -1 || sb.st_size == 0) { return false; }
+
+	// MemoryMap takes the length of the mapping as an int
+	if(sb.st_size > INT_MAX) {
+		DEBUG(verb1) << "Catalog too large to be memory mapped (" << sb.st_size << " bytes)";
+		return false;
+	}
+
+	try {
+		map.open(filename, sb.st_size);
+	} catch(EIOException &e) {
+		DEBUG(verb1) << "Error mapping catalog: " << e.info;
+		return false;
+	}
+
+	if(system::ThreadPool::hardware_concurrency() > 1) {
+		pool.reset(new system::ThreadPool);
+	}
+
+	return true;
+}
+
+int RecordReader::read(std::vector<Asteroid> &out, int from, int to)
+{
+	out.clear();
+	if(to <= from) { return 0; }
+
+	boost::mutex::scoped_lock l(lock);
+	if(!init()) { return -1; }
+
+	const char *data = (const char *)(void *)map + (size_t)from * recordByteLen;
+
+	out.resize(to - from);
+	const int nchunks = (to - from + chunkLen - 1) / chunkLen;
+	std::vector<std::vector<int> > bad(nchunks);
+
+	if(pool.get() == NULL || nchunks == 1) {
+		parseChunk(&parse, data, recordByteLen, &out[0], from, to - from, &bad[0]);
+	} else {
+		for(int k = 0; k != nchunks; k++) {
+			const int at = k * chunkLen;
+			pool->submit(boost::bind(parseChunk, &parse, data + (size_t)at * recordByteLen, recordByteLen,
+				&out[at], from + at, std::min(chunkLen, to - from - at), &bad[k]));
+		}
+		pool->wait();
+	}
+
+	for(int k = 0; k != nchunks; k++) {
+		for(size_t i = 0; i != bad[k].size(); i++) {
+			DEBUG(verb1) << "Error parsing asteroid record " << bad[k][i];
+		}
+	}
+
+	return to - from;
+}
+
+bool peyton::asteroids::readFully(int fd, void *buf, size_t len, off_t offset)
+{
+	char *p = (char *)buf;
+	while(len) {
+		ssize_t n = pread(fd, p, len, offset);
+		if(n == -1 && errno == EINTR) { continue; }
+		if(n <= 0) { return false; }
+
+		p += n; len -= n; offset += n;
+	}
+
+	return true;
+}
@@ -0,0 +1,72 @@
+#ifndef _astro_recordreader_h
+#define _astro_recordreader_h
+
+#include <astro/asteroids/asteroid.h>
+#include <astro/system/memorymap.h>
+#include <astro/system/threadpool.h>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <sys/types.h>
+
+namespace peyton {
+namespace asteroids {
+
+/// parses a single text record of a catalog into an Asteroid
+typedef boost::function<bool (Asteroid &, const char *)> record_parser;
+
+/**
+	\brief Parallel reader of catalogs of fixed-length text records (eg. ASTORB)
+
+	Reads ranges of records by memory mapping the file and parsing chunks
+	of records on one thread per core. The mapping (of the whole file) and
+	the thread pool are created on the first read, and kept until the
+	reader is destroyed. Records are numbered (Asteroid::id) by their
+	position in the file. \a parse must be safe to call from multiple
+	threads.
+
+	read() may be called from several threads at once; the reads are then
+	done one after the other, each one using all of the pool.
+*/
+class RecordReader {
+protected:
+	std::string filename;
+	int recordByteLen;
+	record_parser parse;
+
+	boost::mutex lock;	///< serializes reads, and guards the members below
+	bool tried;		///< whether mapping the file was attempted
+	system::MemoryMap map;
+	std::auto_ptr<system::ThreadPool> pool;
+
+	bool init();
+public:
+	RecordReader() : recordByteLen(0), tried(false) {}
+
+	/// read \a filename, made of records of \a recordByteLen bytes, with \a parse
+	void open(const std::string &filename, int recordByteLen, const record_parser &parse);
+
+	/**
+		Read records [from, to) into \a out. Returns the number of
+		records read, or -1 if the file could not be mapped (in which
+		case the caller should fall back to reading it some other way).
+	*/
+	int read(std::vector<Asteroid> &out, int from, int to);
+};
+
+/**
+	Read \a len bytes at \a offset of the file open as \a fd, without
+	using (or moving) the file position, so that the file can be read from
+	several threads at once. Returns false on error or end of file.
+*/
+bool readFully(int fd, void *buf, size_t len, off_t offset);
+
+}
+}
+
+#endif
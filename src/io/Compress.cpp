@@ -1,20 +1,228 @@
 #include <astro/io/compress.h>
+#include <astro/io/gzstream/parallel.h>
+#include <astro/system/threadpool.h>
 #include <astro/util.h>
 #include <astro/exceptions.h>
 
+#include <boost/bind.hpp>
+
+#include <zlib.h>
+
+#include <set>
+
+#include <cstdio>
 #include <cstdlib>
-#include <sys/wait.h>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace peyton::io;
 using namespace peyton::util;
 using namespace peyton::exceptions;
 
-void compress::gzip(const std::string &filename) throw(EIOException)
+//
+// Serially gzip the contents of in to out, reading blocksize bytes at a time
+//
+static bool deflate_serial(FILE *in, FILE *out, int level, size_t blocksize)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) { return false; }	// 15+16 = gzip wrapper
+
+	vector<unsigned char> ibuf(blocksize), obuf(blocksize);
+	int flush;
+	bool ok = true;
+	do {
+		zs.avail_in = fread(&ibuf[0], 1, ibuf.size(), in);
+		if(ferror(in)) { ok = false; break; }
+		flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
+		zs.next_in = &ibuf[0];
+
+		do {
+			zs.avail_out = obuf.size();
+			zs.next_out = &obuf[0];
+			deflate(&zs, flush);
+			size_t have = obuf.size() - zs.avail_out;
+			if(fwrite(&obuf[0], 1, have, out) != have) { ok = false; break; }
+		} while(zs.avail_out == 0);
+	} while(ok && flush != Z_FINISH);
+
+	deflateEnd(&zs);
+	return ok;
+}
+
+//
+// Gzip the contents of in to the file tmp, on nthreads threads
+//
+static bool deflate_parallel(FILE *in, const string &tmp, int level, int nthreads, size_t blocksize)
+{
+	gzstream::parallel_streambuf out(level, nthreads, blocksize);
+	if(!out.open(tmp.c_str())) { return false; }
+
+	vector<char> ibuf(blocksize);
+	bool ok = true;
+	size_t n;
+	while(ok && (n = fread(&ibuf[0], 1, ibuf.size(), in)) != 0)
+	{
+		ok = out.sputn(&ibuf[0], n) == (streamsize)n;
+	}
+	ok = !ferror(in) && ok;
+
+	return out.close() && ok;
+}
+
+//
+// Compress path to path.gz, via a temporary file. Returns an empty string
+// on success, or a description of the error.
+//
+static string gzip_file(const string &path, int level, int nthreads, size_t blocksize)
+{
+	const string gz = path + ".gz";
+
+	FILE *in = fopen(path.c_str(), "rb");
+	if(in == NULL) { return "cannot open '" + path + "' (" + strerror(errno) + ")"; }
+
+	struct stat sb;
+	bool havestat = fstat(fileno(in), &sb) == 0;
+
+	// a uniquely named temporary, so that concurrent jobs never share one
+	string tmpl = gz + ".tmp.XXXXXX";
+	vector<char> name(tmpl.begin(), tmpl.end());
+	name.push_back(0);
+	int fd = mkstemp(&name[0]);
+	if(fd == -1) { fclose(in); return "cannot create '" + tmpl + "' (" + strerror(errno) + ")"; }
+	const string tmp(&name[0]);
+
+	bool ok;
+	if(nthreads == 1)
+	{
+		FILE *out = fdopen(fd, "wb");
+		if(out == NULL) { close(fd); unlink(tmp.c_str()); fclose(in); return "cannot create '" + tmp + "' (" + strerror(errno) + ")"; }
+
+		ok = deflate_serial(in, out, level, blocksize);
+		ok = (fclose(out) == 0) && ok;
+	}
+	else
+	{
+		close(fd);
+		ok = deflate_parallel(in, tmp, level, nthreads, blocksize);
+	}
+	fclose(in);
+
+	if(!ok)
+	{
+		string err = "error compressing '" + path + "' (" + strerror(errno) + ")";
+		unlink(tmp.c_str());
+		return err;
+	}
+
+	if(havestat)
+	{
+		// keep the permissions and timestamps of the original, like gzip does
+		struct utimbuf ut;
+		ut.actime = sb.st_atime;
+		ut.modtime = sb.st_mtime;
+		chmod(tmp.c_str(), sb.st_mode & 07777);
+		utime(tmp.c_str(), &ut);
+	}
+	if(rename(tmp.c_str(), gz.c_str()) != 0)
+	{
+		string err = "cannot rename '" + tmp + "' to '" + gz + "' (" + strerror(errno) + ")";
+		unlink(tmp.c_str());
+		return err;
+	}
+	if(unlink(path.c_str()) != 0)
+	{
+		return "cannot remove '" + path + "' (" + strerror(errno) + ")";
+	}
+
+	return "";
+}
+
+//
+// Pool job for one file of a batch. Errors, including exceptions, are
+// stored into *err so that they're reported together with the others.
+//
+static void gzip_job(const string *path, int level, size_t blocksize, string *err)
+{
+	try
+	{
+		*err = gzip_file(*path, level, 1, blocksize);
+	}
+	catch(EAny &e)
+	{
+		*err = "error compressing '" + *path + "' (" + e.info + ")";
+	}
+	catch(std::exception &e)
+	{
+		*err = "error compressing '" + *path + "' (" + e.what() + ")";
+	}
+	catch(...)
+	{
+		*err = "error compressing '" + *path + "' (unknown error)";
+	}
+}
+
+void compress::gzip(const std::string &filename, int level, int nthreads, size_t blocksize) throw(EIOException)
 {
-	int status = ::system((string("gzip -f ") + filename).c_str());
-	if(status == -1 || WEXITSTATUS(status) != 0)
+	if(blocksize == 0) { blocksize = default_blocksize; }
+
+	string err = gzip_file(filename, level, nthreads, blocksize);
+	if(!err.empty())
+	{
+		THROW(EIOException, "Error gzipping file '" + filename + "': " + err);
+	}
+}
+
+void compress::gzip(const std::vector<std::string> &paths, int level, int nthreads, size_t blocksize) throw(EIOException)
+{
+	if(paths.empty()) { return; }
+	if(blocksize == 0) { blocksize = default_blocksize; }
+
+	// a path listed more than once is compressed once
+	vector<size_t> todo;
+	set<string> seen;
+	for(size_t i = 0; i != paths.size(); i++)
+	{
+		if(seen.insert(paths[i]).second) { todo.push_back(i); }
+	}
+
+	vector<string> errors(paths.size());
+	try
+	{
+		system::ThreadPool pool(std::min<int>(nthreads > 0 ? nthreads : system::ThreadPool::hardware_concurrency(), todo.size()));
+		for(size_t k = 0; k != todo.size(); k++)
+		{
+			const size_t i = todo[k];
+			pool.submit(boost::bind(gzip_job, &paths[i], level, blocksize, &errors[i]));
+		}
+		pool.wait();
+	}
+	catch(EThreadPool &e)
+	{
+		THROW(EIOException, "Error gzipping files: " + e.info);
+	}
+	catch(std::exception &e)
+	{
+		// eg. boost::thread_resource_error, if the workers cannot be started
+		THROW(EIOException, string("Error gzipping files: ") + e.what());
+	}
+
+	string msg;
+	int nfailed = 0;
+	for(size_t i = 0; i != errors.size(); i++)
+	{
+		if(errors[i].empty()) { continue; }
+		msg += "\n  " + errors[i];
+		nfailed++;
+	}
+
+	if(nfailed)
 	{
-		THROW(EIOException, string("Error gzipping file '") + filename + "' (system() returned " + str(status) + " - exit code " + str(WEXITSTATUS(status)));
+		THROW(EIOException, "Error gzipping " + str(nfailed) + " of " + str((int)paths.size()) + " files:" + msg);
 	}
 }
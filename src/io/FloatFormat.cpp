@@ -0,0 +1,478 @@
+//
+// Fast floating point to text conversion.
+//
+// Shortest representations are generated with Florian Loitsch's Grisu2
+// algorithm ("Printing Floating-Point Numbers Quickly and Accurately with
+// Integers", PLDI 2010), following the structure of Milo Yip's
+// implementation. Fixed precision conversions are done by scaling by an
+// exactly representable power of ten and rounding to an integer; cases
+// where that could round differently than printf() are passed to
+// snprintf().
+//
+
+#include <astro/io/format.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+typedef unsigned long long uint64;
+
+namespace {
+
+	// 64-bit significand with a binary exponent ("do it yourself floating point")
+	struct diyfp
+	{
+		uint64 f;
+		int e;
+
+		diyfp() {}
+		diyfp(uint64 f_, int e_) : f(f_), e(e_) {}
+
+		diyfp operator-(const diyfp &r) const { return diyfp(f - r.f, e); }
+
+		// product, rounded to the upper 64 bits
+		diyfp operator*(const diyfp &r) const
+		{
+			const uint64 M32 = 0xFFFFFFFFULL;
+			uint64 a = f >> 32, b = f & M32, c = r.f >> 32, d = r.f & M32;
+			uint64 ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+			uint64 tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+			tmp += 1ULL << 31;
+			return diyfp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + r.e + 64);
+		}
+
+		diyfp normalize() const
+		{
+			diyfp r = *this;
+			while(!(r.f & (1ULL << 63))) { r.f <<= 1; r.e--; }
+			return r;
+		}
+	};
+
+	// 10^k for k = -348, -340, ..., 340, normalized to 64 bit significands
+	const uint64 cached_f[] = {
+		0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+		0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+		0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+		0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+		0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+		0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+		0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+		0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+		0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+		0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+		0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+		0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+		0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+		0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+		0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+		0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+		0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+		0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+		0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+		0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+		0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+		0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+	};
+	const short cached_e[] = {
+		-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927, -901, -874, -847, -821,
+		-794, -768, -741, -715, -688, -661, -635, -608, -582, -555, -529, -502, -475, -449, -422, -396,
+		-369, -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+		56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+		481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+		907, 933, 960, 986, 1013, 1039, 1066,
+	};
+
+	const uint64 pow10_u64[] = {
+		1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+		1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+		100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+		1000000000000000000ULL, 10000000000000000000ULL
+	};
+
+	// powers of ten exactly representable as doubles
+	const double pow10_dbl[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Shortest representation (Grisu2)
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// Find the cached power c = 10^-K such that the product of c with a
+// number of binary exponent e lands in the [-60, -32] exponent range
+//
+static diyfp cached_power(int e, int &K)
+{
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	if(dk - k > 0.0) { k++; }
+
+	unsigned index = (unsigned)((k >> 3) + 1);
+	K = -(-348 + (int)(index << 3));
+	return diyfp(cached_f[index], cached_e[index]);
+}
+
+static void grisu_round(char *buf, int len, uint64 delta, uint64 rest, uint64 ten_kappa, uint64 wp_w)
+{
+	while(rest < wp_w && delta - rest >= ten_kappa &&
+		(rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+	{
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static void digit_gen(const diyfp &W, const diyfp &Mp, uint64 delta, char *buf, int &len, int &K)
+{
+	const diyfp one(1ULL << -Mp.e, Mp.e);
+	const diyfp wp_w = Mp - W;
+	unsigned p1 = (unsigned)(Mp.f >> -one.e);
+	uint64 p2 = Mp.f & (one.f - 1);
+
+	int kappa = 1;
+	while(kappa < 10 && p1 >= pow10_u64[kappa]) { kappa++; }
+
+	len = 0;
+	while(kappa > 0)
+	{
+		unsigned d = p1 / (unsigned)pow10_u64[kappa - 1];
+		p1 %= (unsigned)pow10_u64[kappa - 1];
+		if(d || len) { buf[len++] = '0' + d; }
+		kappa--;
+
+		uint64 tmp = ((uint64)p1 << -one.e) + p2;
+		if(tmp <= delta)
+		{
+			K += kappa;
+			grisu_round(buf, len, delta, tmp, pow10_u64[kappa] << -one.e, wp_w.f);
+			return;
+		}
+	}
+
+	while(true)
+	{
+		p2 *= 10;
+		delta *= 10;
+		char d = (char)(p2 >> -one.e);
+		if(d || len) { buf[len++] = '0' + d; }
+		p2 &= one.f - 1;
+		kappa--;
+		if(p2 < delta)
+		{
+			K += kappa;
+			grisu_round(buf, len, delta, p2, one.f, -kappa < 20 ? wp_w.f * pow10_u64[-kappa] : 0);
+			return;
+		}
+	}
+}
+
+//
+// Generate the shortest digit string d such that d * 10^K reads back as
+// the value f * 2^e, with a significand of sigbits bits (including the
+// hidden bit, if any). f must be nonzero.
+//
+static void grisu2(uint64 f, int e, int sigbits, char *buf, int &len, int &K)
+{
+	const uint64 hidden = 1ULL << (sigbits - 1);
+
+	// boundaries of the interval rounding to v
+	diyfp v(f, e);
+	diyfp wp = diyfp((f << 1) + 1, e - 1).normalize();
+	diyfp wm = (f == hidden) ? diyfp((f << 2) - 1, e - 2) : diyfp((f << 1) - 1, e - 1);
+	wm.f <<= wm.e - wp.e;
+	wm.e = wp.e;
+
+	const diyfp c_mk = cached_power(wp.e, K);
+	const diyfp W = v.normalize() * c_mk;
+	diyfp Wp = wp * c_mk;
+	diyfp Wm = wm * c_mk;
+	Wm.f++;
+	Wp.f--;
+	digit_gen(W, Wp, Wp.f - Wm.f, buf, len, K);
+}
+
+static void append_exponent(std::string &out, int e, char letter)
+{
+	out += letter;
+	out += e < 0 ? '-' : '+';
+	if(e < 0) { e = -e; }
+	if(e >= 100) { out += '0' + e / 100; e %= 100; }
+	out += '0' + e / 10;
+	out += '0' + e % 10;
+}
+
+//
+// Lay out the digits d[0..len) * 10^K: in positional notation for
+// decimal exponents in [-4, 15], in scientific notation otherwise
+//
+static void append_digits(std::string &out, const char *d, int len, int K)
+{
+	const int kk = len + K;		// position of the decimal point
+	if(kk >= -3 && kk <= 16)
+	{
+		if(kk <= 0)
+		{
+			out += "0.";
+			out.append(-kk, '0');
+			out.append(d, len);
+		}
+		else if(kk >= len)
+		{
+			out.append(d, len);
+			out.append(kk - len, '0');
+		}
+		else
+		{
+			out.append(d, kk);
+			out += '.';
+			out.append(d + kk, len - kk);
+		}
+	}
+	else
+	{
+		out += d[0];
+		if(len > 1) { out += '.'; out.append(d + 1, len - 1); }
+		append_exponent(out, kk - 1, 'e');
+	}
+}
+
+void peyton::io::append_shortest(std::string &out, double x)
+{
+	uint64 u;
+	memcpy(&u, &x, sizeof(u));
+
+	if(u >> 63) { out += '-'; }
+
+	const int be = (int)((u >> 52) & 0x7FF);
+	uint64 f = u & 0x000FFFFFFFFFFFFFULL;
+	if(be == 0x7FF) { out += f ? "nan" : "inf"; return; }
+	if(be == 0 && f == 0) { out += '0'; return; }
+
+	int e;
+	if(be) { f |= 1ULL << 52; e = be - 1075; } else { e = -1074; }
+
+	char buf[32];
+	int len, K;
+	grisu2(f, e, 53, buf, len, K);
+	append_digits(out, buf, len, K);
+}
+
+void peyton::io::append_shortest(std::string &out, float x)
+{
+	unsigned u;
+	memcpy(&u, &x, sizeof(u));
+
+	if(u >> 31) { out += '-'; }
+
+	const int be = (int)((u >> 23) & 0xFF);
+	uint64 f = u & 0x007FFFFF;
+	if(be == 0xFF) { out += f ? "nan" : "inf"; return; }
+	if(be == 0 && f == 0) { out += '0'; return; }
+
+	int e;
+	if(be) { f |= 1ULL << 23; e = be - 150; } else { e = -149; }
+
+	char buf[32];
+	int len, K;
+	grisu2(f, e, 24, buf, len, K);
+	append_digits(out, buf, len, K);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Fixed precision (%e, %f, %g)
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// Compute n = round(ax * 10^k) for ax > 0. Returns false if the result
+// does not fit into 53 bits, or if the exact product is so close to a
+// tie that the (correctly rounded) floating point product cannot tell
+// which way it should be rounded.
+//
+static bool scaled_round(double ax, int k, uint64 &n)
+{
+	if(k > 22 || k < -22) { return false; }
+
+	double y = k >= 0 ? ax * pow10_dbl[k] : ax / pow10_dbl[-k];
+	if(!(y < 4e15)) { return false; }
+
+	double fl = floor(y), frac = y - fl;
+	if(fabs(frac - 0.5) <= y * 2.3e-16) { return false; }	// within an ulp of a tie
+
+	n = (uint64)fl + (frac > 0.5 ? 1 : 0);
+	return true;
+}
+
+static int utoa(char *end, uint64 n)
+{
+	char *p = end;
+	do { *--p = '0' + n % 10; n /= 10; } while(n);
+	return end - p;
+}
+
+namespace {
+	// small fixed size output buffer
+	struct charbuf
+	{
+		char b[64];
+		int n;
+
+		charbuf() : n(0) {}
+		void put(char c) { b[n++] = c; }
+		void put(const char *s, int len) { memcpy(b + n, s, len); n += len; }
+		void fill(int len, char c) { memset(b + n, c, len); n += len; }
+	};
+}
+
+//
+// Format |x| into body (without sign or padding). Returns false if the
+// conversion cannot be done exactly here.
+//
+static bool format_abs(charbuf &body, double ax, int prec, char conv, bool alt)
+{
+	char dig[32];
+	char *end = dig + sizeof(dig);
+	uint64 n;
+
+	if(conv == 'f' || conv == 'F')
+	{
+		if(prec > 22) { return false; }
+		if(ax == 0) { n = 0; }
+		else if(!scaled_round(ax, prec, n)) { return false; }
+
+		int len = utoa(end, n);
+		if(len < prec + 1) { memset(end - (prec + 1), '0', prec + 1 - len); len = prec + 1; }
+		body.put(end - len, len - prec);
+		if(prec || alt) { body.put('.'); }
+		body.put(end - prec, prec);
+		return true;
+	}
+
+	// %e and %g: find the decimal exponent X and the significant digits
+	const bool g = conv == 'g' || conv == 'G';
+	int P = prec;
+	if(g && P == 0) { P = 1; }
+	const int ndig = g ? P : P + 1;
+	if(ndig > 15) { return false; }
+
+	int X = 0;
+	if(ax == 0) { n = 0; }
+	else
+	{
+		X = (int)floor(log10(ax));
+		for(int tries = 0; ; tries++)
+		{
+			if(tries == 3 || !scaled_round(ax, ndig - 1 - X, n)) { return false; }
+			if(n >= pow10_u64[ndig]) { X++; continue; }
+			if(n < pow10_u64[ndig - 1]) { X--; continue; }
+			break;
+		}
+	}
+
+	int len = utoa(end, n);
+	if(len < ndig) { memset(end - ndig, '0', ndig - len); len = ndig; }
+	const char *d = end - len;
+
+	if(g)
+	{
+		// strip trailing zeros, unless in alternative form
+		if(!alt) { while(len > 1 && d[len - 1] == '0') { len--; } }
+
+		if(P > X && X >= -4)
+		{
+			// %f style, with P - 1 - X digits after the decimal point
+			if(X < 0)
+			{
+				body.put("0.", 2);
+				body.fill(-X - 1, '0');
+				body.put(d, len);
+			}
+			else if(X + 1 >= len)
+			{
+				body.put(d, len);
+				body.fill(X + 1 - len, '0');
+				if(alt) { body.put('.'); }
+			}
+			else
+			{
+				body.put(d, X + 1);
+				body.put('.');
+				body.put(d + X + 1, len - X - 1);
+			}
+			return true;
+		}
+	}
+
+	body.put(d[0]);
+	if(len > 1 || alt) { body.put('.'); }
+	body.put(d + 1, len - 1);
+
+	// exponent
+	body.put((conv == 'E' || conv == 'G') ? 'E' : 'e');
+	body.put(X < 0 ? '-' : '+');
+	if(X < 0) { X = -X; }
+	if(X >= 100) { body.put('0' + X / 100); X %= 100; }
+	body.put('0' + X / 10);
+	body.put('0' + X % 10);
+	return true;
+}
+
+static void append_snprintf(std::string &out, double x, const peyton::io::trad_format &tf)
+{
+	char code[32], *c = code;
+	*c++ = '%';
+	if(tf.flag) { *c++ = tf.flag; }
+	if(tf.width != -1) { c += sprintf(c, "%d", tf.width); }
+	if(tf.prec != -1) { c += sprintf(c, ".%d", tf.prec); }
+	*c++ = tf.conversion;
+	*c = 0;
+
+	const size_t len = out.size(), guess = 64;
+	out.resize(len + guess);
+	int n = snprintf(&out[len], guess, code, x);
+	if(n >= (int)guess)
+	{
+		out.resize(len + n + 1);
+		snprintf(&out[len], n + 1, code, x);
+	}
+	out.resize(len + (n > 0 ? n : 0));
+}
+
+void peyton::io::append_double(std::string &out, double x, const trad_format &tf)
+{
+	const char conv = tf.conversion;
+	const char flag = tf.flag;
+	bool fast = (conv == 'e' || conv == 'E' || conv == 'f' || conv == 'F' || conv == 'g' || conv == 'G') &&
+		(flag == 0 || flag == '-' || flag == '0' || flag == '+' || flag == ' ' ||
+			(flag == '#' && conv != 'g' && conv != 'G')) &&
+		(x - x == 0);	// finite
+
+	if(fast)
+	{
+		const bool neg = x < 0 || (x == 0 && 1/x < 0);
+		const int prec = tf.prec == -1 ? 6 : tf.prec;
+
+		charbuf body;
+		if(format_abs(body, neg ? -x : x, prec, conv, flag == '#'))
+		{
+			char sign = neg ? '-' : (flag == '+' ? '+' : (flag == ' ' ? ' ' : 0));
+			const int len = body.n + (sign ? 1 : 0);
+			const int pad = tf.width > len ? tf.width - len : 0;
+
+			if(pad && flag != '-' && flag != '0') { out.append(pad, ' '); }
+			if(sign) { out += sign; }
+			if(pad && flag == '0') { out.append(pad, '0'); }
+			out.append(body.b, body.n);
+			if(pad && flag == '-') { out.append(pad, ' '); }
+			return;
+		}
+	}
+
+	append_snprintf(out, x, tf);
+}
@@ -9,6 +9,7 @@
 
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
 
 static std::string conversions("diouxXeEfFgGaAcCsSpn");
 static std::string flags("#0- +'I");
@@ -18,6 +19,77 @@ using namespace peyton::io;
 using namespace peyton::exceptions;
 using namespace std;
 
+//
+// Parses the conversion specification beginning at formatt[to] (that is,
+// just past the '%'), storing 'traditional' specs into tf. On return, to
+// points one past the end of the parsed specification. Returns false if
+// the specification is incomplete or malformed.
+//
+static bool parse_spec(const std::string &formatt, int &to, trad_format &tf)
+{
+	tf.conversion = 0;
+	if(formatt[to] == '@')
+	{
+		++to; 
+	}
+	else if(formatt[to] == '(')
+	{
+		int brackets = 0;
+		do {
+			switch(formatt[to]) {
+				case '(' : brackets++; break;
+				case ')' : brackets--; break;
+			}
+			++to;
+		} while(to != formatt.size() && brackets);
+		if(to != formatt.size() && formatt[to] == '@') // @ is optional in () are used
+		{
+			++to;
+		}
+	}
+	else
+	{
+		// old style format
+		if(flags.find(formatt[to]) != string::npos) { tf.flag = formatt[to]; ++to; } else { tf.flag = 0; }
+		if(to == formatt.size()) { return false; }
+
+		tf.width = -1;
+		if(isdigit(formatt[to]))
+		{
+			tf.width = formatt[to] - '0'; ++to;
+			while(to != formatt.size() && isdigit(formatt[to])) { tf.width = 10*tf.width + (formatt[to] - '0'); ++to; }
+			if(to == formatt.size()) { return false; }
+		}
+
+		tf.prec = -1;
+		if(formatt[to] == '.')
+		{
+			++to;
+			tf.prec = 0;
+			while(to != formatt.size() && isdigit(formatt[to])) { tf.prec = 10*tf.prec + (formatt[to] - '0'); ++to; }
+			if(to == formatt.size()) { return false; }
+		}
+
+		tf.length[0] = 0;
+		if(length.find(formatt[to]) != string::npos)
+		{
+			tf.length[0] = formatt[to]; ++to;
+			tf.length[1] = 0;
+			switch(tf.length[0]) {
+			case 'h': case 'l':
+				if(to == formatt.size()) { return false; }
+				if(formatt[to] == tf.length[0]) { tf.length[1] = tf.length[0]; ++to; }
+				break;
+			}
+		}
+
+		if(conversions.find(formatt[to]) != string::npos) { tf.conversion = formatt[to]; ++to; }
+		else { return false; }
+	}
+
+	return true;
+}
+
 Formatter::Formatter(const std::string &fmt, bool arw)
 : formatt(fmt), out(new ostringstream), sstrm(true), at(0), to(0), autorewind(arw)
 {
@@ -62,65 +134,7 @@ void Formatter::pop()
 		// ectract formatt string
 		//
 
-		tf.conversion = 0;
-		if(formatt[to] == '@')
-		{
-			++to; 
-		}
-		else if(formatt[to] == '(')
-		{
-			int brackets = 0;
-			do {
-				switch(formatt[to]) {
-					case '(' : brackets++; break;
-					case ')' : brackets--; break;
-				}
-				++to;
-			} while(to != formatt.size() && brackets);
-			if(to != formatt.size() && formatt[to] == '@') // @ is optional in () are used
-			{
-				++to;
-			}
-		}
-		else
-		{
-			// old style format
-			if(flags.find(formatt[to]) != string::npos) { tf.flag = formatt[to]; ++to; } else { tf.flag = 0; }
-			if(to == formatt.size()) { continue; }
-
-			tf.width = -1;
-			if(isdigit(formatt[to]))
-			{
-				tf.width = formatt[to] - '0'; ++to;
-				while(to != formatt.size() && isdigit(formatt[to])) { tf.width = 10*tf.width + (formatt[to] - '0'); ++to; }
-				if(to == formatt.size()) { continue; }
-			}
-
-			tf.prec = -1;
-			if(formatt[to] == '.')
-			{
-				++to;
-				tf.prec = 0;
-				while(to != formatt.size() && isdigit(formatt[to])) { tf.prec = 10*tf.prec + (formatt[to] - '0'); ++to; }
-				if(to == formatt.size()) { continue; }
-			}
-
-			tf.length[0] = 0;
-			if(length.find(formatt[to]) != string::npos)
-			{
-				tf.length[0] = formatt[to]; ++to;
-				tf.length[1] = 0;
-				switch(tf.length[0]) {
-				case 'h': case 'l':
-					if(to == formatt.size()) { continue; }
-					if(formatt[to] == tf.length[0]) { tf.length[1] = tf.length[0]; }
-					break;
-				}
-			}
-
-			if(conversions.find(formatt[to]) != string::npos) { tf.conversion = formatt[to]; ++to; }
-			else { continue; } // TODO: emit a warning we had a bad format string
-		}
+		if(!parse_spec(formatt, to, tf)) { continue; } // TODO: emit a warning we had a bad format string
 
 		break;
 	};
@@ -201,12 +215,15 @@ void peyton::io::format_type(Formatter &f, const long unsigned &x)
 
 void peyton::io::format_type(Formatter &f, const double &x)
 {
-	char *c; int n;
-	if(double_formats.find(f.tf.conversion) != string::npos)
+	if(f.tf.conversion != 0 && double_formats.find(f.tf.conversion) != string::npos)
 	{
-		asprintf(&c, f.front().c_str(), x);
-		f.stream() << c;
-		free(c);
+		append_double(f.buffer(), x, f.tf);
+		f.stream();
+	}
+	else if(f.tf.conversion == 0 && f.formatt[f.at+1] == '@')
+	{
+		append_shortest(f.buffer(), x);
+		f.stream();
 	}
 	else
 	{
@@ -214,6 +231,19 @@ void peyton::io::format_type(Formatter &f, const double &x)
 	}
 }
 
+void peyton::io::format_type(Formatter &f, const float &x)
+{
+	if(f.tf.conversion == 0 && f.formatt[f.at+1] == '@')
+	{
+		append_shortest(f.buffer(), x);
+		f.stream();
+	}
+	else
+	{
+		format_type(f, (double)x);
+	}
+}
+
 void peyton::io::format_type(Formatter &f, const char *x)
 {
 	char *c; int n;
@@ -228,3 +258,318 @@ void peyton::io::format_type(Formatter &f, const char *x)
 		THROW(EIOFormat, "Error in format string - [" + f.front() + "] format requested for a string");
 	}
 }
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// compiled_format
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+compiled_format::compiled_format(const std::string &fmt, bool arw)
+: autorewind(arw)
+{
+	int to = 0;
+	while(true)
+	{
+		std::string &literal = specs.empty() ? head : specs.back().text;
+
+		int at = to;
+		while(to != fmt.size() && fmt[to] != '%') { ++to; }
+		literal.append(fmt, at, to - at);
+
+		if(to == fmt.size()) { break; }
+		++to;
+
+		// %% -> %
+		if(to != fmt.size() && fmt[to] == '%') { literal += '%'; ++to; continue; }
+
+		spec s;
+		s.tf.flag = 0;
+		s.tf.width = -1;
+		s.tf.prec = -1;
+		s.tf.length[0] = s.tf.length[1] = 0;
+
+		int begin = to - 1;
+		if(!parse_spec(fmt, to, s.tf))
+		{
+			THROW(EIOFormat, "Malformed conversion specification [" + fmt.substr(begin, to - begin + 1) + "] in format string [" + fmt + "]");
+		}
+		s.code = fmt.substr(begin, to - begin);
+
+		if(s.tf.conversion)
+		{
+			int lenmod = s.tf.length[0] ? (s.tf.length[1] ? 2 : 1) : 0;
+			s.prefix = s.code.substr(0, s.code.size() - 1 - lenmod);
+		}
+		else
+		{
+			s.prefix = "%";
+		}
+
+		specs.push_back(s);
+	}
+}
+
+static compiled_format::spec raw_spec()
+{
+	compiled_format::spec s;
+	s.code = s.prefix = "%";
+	s.code += '@';
+	s.tf.flag = s.tf.conversion = 0;
+	s.tf.width = s.tf.prec = -1;
+	s.tf.length[0] = s.tf.length[1] = 0;
+	return s;
+}
+
+const compiled_format::spec compiled_formatter::raw = raw_spec();
+
+const compiled_format::spec &compiled_formatter::next()
+{
+	if(at == fmt.specs.size())
+	{
+		if(!fmt.autorewind || fmt.specs.empty()) { return raw; }
+
+		out += fmt.head;
+		at = 0;
+	}
+	return fmt.specs[at++];
+}
+
+//
+// snprintf() x straight to the end of out
+//
+template<typename T>
+static void append_printf(std::string &out, const char *code, T x)
+{
+	const size_t len = out.size(), guess = 64;
+	out.resize(len + guess);
+	int n = snprintf(&out[len], guess, code, x);
+	if(n >= (int)guess)
+	{
+		out.resize(len + n + 1);
+		snprintf(&out[len], n + 1, code, x);
+	}
+	out.resize(len + (n > 0 ? n : 0));
+}
+
+//
+// snprintf() x using the spec's flags, width and precision, with the
+// length modifier appropriate for T and the given conversion character
+//
+template<typename T>
+static void append_spec(std::string &out, const compiled_format::spec &s, const char *lenmod, char conversion, T x)
+{
+	char code[64];
+	const size_t n = s.prefix.size(), l = strlen(lenmod);
+	if(n + l + 2 > sizeof(code))
+	{
+		std::string c = s.prefix + lenmod + conversion;
+		append_printf(out, c.c_str(), x);
+		return;
+	}
+
+	memcpy(code, s.prefix.data(), n);
+	memcpy(code + n, lenmod, l);
+	code[n + l] = conversion;
+	code[n + l + 1] = 0;
+	append_printf(out, code, x);
+}
+
+//
+// Fast path for decimal integers with no precision and an optional
+// width, '-' or '0' flags. Returns false if the spec is not of that kind.
+//
+template<typename U, typename I>
+static bool append_decimal(std::string &out, const trad_format &tf, I x)
+{
+	if(tf.prec != -1 || (tf.flag != 0 && tf.flag != '-' && tf.flag != '0')) { return false; }
+
+	const bool neg = x < I(0);
+	U u = neg ? U(0) - U(x) : U(x);
+
+	char buf[24];
+	char *end = buf + sizeof(buf), *p = end;
+	do { *--p = '0' + u % 10; u /= 10; } while(u);
+
+	const int len = (end - p) + neg;
+	const int pad = tf.width > len ? tf.width - len : 0;
+
+	switch(tf.flag)
+	{
+	case '-':
+		if(neg) { out += '-'; }
+		out.append(p, end);
+		out.append(pad, ' ');
+		break;
+	case '0':
+		if(neg) { out += '-'; }
+		out.append(pad, '0');
+		out.append(p, end);
+		break;
+	default:
+		out.append(pad, ' ');
+		if(neg) { out += '-'; }
+		out.append(p, end);
+	}
+	return true;
+}
+
+template<typename U, typename I>
+static void format_signed(std::string &out, const compiled_format::spec &s, I x, const char *lenmod)
+{
+	const char c = s.tf.conversion;
+	if(c == 0 && s.code[1] != '(') { append_decimal<U>(out, s.tf, x); return; }
+	if(!(c == 'd' || c == 'i' || c == 'c'))
+	{
+		THROW(EIOFormat, "Error in format string - [" + s.code + "] format requested for an integer");
+	}
+
+	if(c == 'c' || !append_decimal<U>(out, s.tf, x))
+	{
+		append_spec(out, s, c == 'c' ? "" : lenmod, c, x);
+	}
+}
+
+template<typename I>
+static void format_unsigned(std::string &out, const compiled_format::spec &s, I x, const char *lenmod)
+{
+	const char c = s.tf.conversion;
+	if(c == 0 && s.code[1] != '(') { append_decimal<I>(out, s.tf, x); return; }
+	if(unsigned_formats.find(c) == string::npos)
+	{
+		THROW(EIOFormat, "Error in format string - [" + s.code + "] format requested for an unsigned integer");
+	}
+
+	if(c != 'u' || !append_decimal<I>(out, s.tf, x))
+	{
+		append_spec(out, s, lenmod, c, x);
+	}
+}
+
+compiled_formatter &compiled_formatter::operator<<(const int x)
+{
+	const compiled_format::spec &s = next();
+	format_signed<unsigned>(out, s, x, "");
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const long x)
+{
+	const compiled_format::spec &s = next();
+	format_signed<unsigned long>(out, s, x, "l");
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const long long x)
+{
+	const compiled_format::spec &s = next();
+	format_signed<unsigned long long>(out, s, x, "ll");
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const unsigned x)
+{
+	const compiled_format::spec &s = next();
+	format_unsigned(out, s, x, "");
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const unsigned long x)
+{
+	const compiled_format::spec &s = next();
+	format_unsigned(out, s, x, "l");
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const unsigned long long x)
+{
+	const compiled_format::spec &s = next();
+	format_unsigned(out, s, x, "ll");
+	done(s);
+	return *this;
+}
+
+static void format_double(std::string &out, const compiled_format::spec &s, double x)
+{
+	const char c = s.tf.conversion;
+	if(c == 0 && s.code[1] != '(')
+	{
+		append_shortest(out, x);
+	}
+	else if(c != 0 && double_formats.find(c) != string::npos)
+	{
+		append_double(out, x, s.tf);
+	}
+	else
+	{
+		THROW(EIOFormat, "Error in format string - [" + s.code + "] format requested for a double");
+	}
+}
+
+compiled_formatter &compiled_formatter::operator<<(const double x)
+{
+	const compiled_format::spec &s = next();
+	format_double(out, s, x);
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const float x)
+{
+	const compiled_format::spec &s = next();
+	if(s.tf.conversion == 0 && s.code[1] != '(')
+	{
+		append_shortest(out, x);
+	}
+	else
+	{
+		format_double(out, s, x);
+	}
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const char *x)
+{
+	const compiled_format::spec &s = next();
+	const char c = s.tf.conversion;
+	if(!((c == 0 && s.code[1] != '(') || c == 's'))
+	{
+		THROW(EIOFormat, "Error in format string - [" + s.code + "] format requested for a string");
+	}
+
+	if(x != NULL && s.tf.width == -1 && s.tf.prec == -1)
+	{
+		out += x;
+	}
+	else
+	{
+		append_spec(out, s, "", 's', x);
+	}
+	done(s);
+	return *this;
+}
+
+compiled_formatter &compiled_formatter::operator<<(const std::string &x)
+{
+	const compiled_format::spec &s = next();
+	const char c = s.tf.conversion;
+	if(!((c == 0 && s.code[1] != '(') || c == 's'))
+	{
+		THROW(EIOFormat, "Error in format string - [" + s.code + "] format requested for a string");
+	}
+
+	if(s.tf.width == -1 && s.tf.prec == -1)
+	{
+		out += x;
+	}
+	else
+	{
+		append_spec(out, s, "", 's', x.c_str());
+	}
+	done(s);
+	return *this;
+}
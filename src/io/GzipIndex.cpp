@@ -0,0 +1,353 @@
+//
+// Access point index for gzip files, after Mark Adler's zran.c example from
+// the zlib distribution.
+//
+
+#include <astro/io/gzstream/index.h>
+#include <astro/system/log.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstring>
+
+using namespace peyton::io::gzstream;
+
+const unsigned long long gzindex::default_span;
+
+static const char idxmagic[8] = { 'G', 'Z', 'I', 'D', 'X', 0, 0, 2 };
+
+// size and modification time (in ns) of the open file fp
+static bool file_stat(FILE *fp, unsigned long long &size, long long &mtime)
+{
+	struct stat buf;
+	if(fstat(fileno(fp), &buf) != 0) { return false; }
+	size = buf.st_size;
+	mtime = buf.st_mtim.tv_sec * 1000000000LL + buf.st_mtim.tv_nsec;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// gzindex
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+bool gzindex::build(const std::string &gzfn, unsigned long long span_)
+{
+	FILE *fp = fopen(gzfn.c_str(), "rb");
+	if(fp == NULL) { DEBUG(verb1) << "Error opening [" << gzfn << "]"; return false; }
+
+	points.clear();
+	span = span_;
+	length = 0;
+	if(!file_stat(fp, csize, cmtime)) { csize = 0; cmtime = 0; }
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit2(&zs, 47) != Z_OK)	// 47 = automatic zlib or gzip header detection
+	{
+		fclose(fp);
+		return false;
+	}
+
+	std::vector<unsigned char> input(256*1024);
+	std::vector<unsigned char> window(winsize);
+
+	unsigned long long totin = 0, totout = 0, last = 0;
+	int ret = Z_OK;
+	do {
+		zs.avail_in = fread(&input[0], 1, input.size(), fp);
+		if(zs.avail_in == 0) { ret = Z_DATA_ERROR; break; }	// premature end of file
+		zs.next_in = &input[0];
+
+		do {
+			if(zs.avail_out == 0)
+			{
+				zs.avail_out = winsize;
+				zs.next_out = &window[0];
+			}
+
+			// inflate up to the end of a deflate block, keeping track of the offsets
+			totin += zs.avail_in;
+			totout += zs.avail_out;
+			ret = inflate(&zs, Z_BLOCK);
+			totin -= zs.avail_in;
+			totout -= zs.avail_out;
+
+			if(ret == Z_NEED_DICT) { ret = Z_DATA_ERROR; }
+			if(ret == Z_MEM_ERROR || ret == Z_DATA_ERROR) { break; }
+			if(ret == Z_STREAM_END) { break; }
+
+			// at the end of a block (but not the last one), add an access point
+			if((zs.data_type & 128) && !(zs.data_type & 64) &&
+				(totout == 0 || totout - last > span))
+			{
+				points.push_back(point());
+				point &p = points.back();
+				p.bits = zs.data_type & 7;
+				p.in = totin;
+				p.out = totout;
+
+				// unroll the circular window buffer
+				size_t left = zs.avail_out;
+				if(left) { memcpy(p.window, &window[winsize - left], left); }
+				if(left < winsize) { memcpy(p.window + left, &window[0], winsize - left); }
+
+				last = totout;
+			}
+		} while(zs.avail_in != 0);
+	} while(ret != Z_STREAM_END);
+
+	inflateEnd(&zs);
+	fclose(fp);
+
+	if(ret != Z_STREAM_END || points.empty())
+	{
+		DEBUG(verb1) << "Error indexing [" << gzfn << "] - corrupt or truncated gzip file";
+		points.clear();
+		return false;
+	}
+
+	length = totout;
+	return true;
+}
+
+bool gzindex::save(const std::string &idxfn) const
+{
+	FILE *fp = fopen(idxfn.c_str(), "wb");
+	if(fp == NULL) { DEBUG(verb1) << "Error opening [" << idxfn << "] for writing"; return false; }
+
+	unsigned long long n = points.size();
+	bool ok = fwrite(idxmagic, sizeof(idxmagic), 1, fp) == 1 &&
+		fwrite(&span, sizeof(span), 1, fp) == 1 &&
+		fwrite(&length, sizeof(length), 1, fp) == 1 &&
+		fwrite(&csize, sizeof(csize), 1, fp) == 1 &&
+		fwrite(&cmtime, sizeof(cmtime), 1, fp) == 1 &&
+		fwrite(&n, sizeof(n), 1, fp) == 1;
+
+	for(std::deque<point>::const_iterator p = points.begin(); ok && p != points.end(); ++p)
+	{
+		ok = fwrite(&*p, sizeof(point), 1, fp) == 1;
+	}
+
+	ok = (fclose(fp) == 0) && ok;
+	if(!ok) { DEBUG(verb1) << "Error writing gzip index [" << idxfn << "]"; }
+	return ok;
+}
+
+bool gzindex::load(const std::string &idxfn, const std::string &gzfn)
+{
+	FILE *fp = fopen(idxfn.c_str(), "rb");
+	if(fp == NULL) { return false; }
+
+	char magic[sizeof(idxmagic)];
+	unsigned long long n = 0;
+	bool ok = fread(magic, sizeof(magic), 1, fp) == 1 &&
+		!memcmp(magic, idxmagic, sizeof(idxmagic)) &&
+		fread(&span, sizeof(span), 1, fp) == 1 &&
+		fread(&length, sizeof(length), 1, fp) == 1 &&
+		fread(&csize, sizeof(csize), 1, fp) == 1 &&
+		fread(&cmtime, sizeof(cmtime), 1, fp) == 1 &&
+		fread(&n, sizeof(n), 1, fp) == 1 &&
+		n != 0;
+
+	points.clear();
+	if(ok) { points.resize(n); }
+	for(std::deque<point>::iterator p = points.begin(); ok && p != points.end(); ++p)
+	{
+		ok = fread(&*p, sizeof(point), 1, fp) == 1;
+	}
+	fclose(fp);
+
+	if(ok && !gzfn.empty())
+	{
+		// refuse to use an index of a different (or since modified) file
+		FILE *gz = fopen(gzfn.c_str(), "rb");
+		unsigned long long size;
+		long long mtime;
+		ok = gz != NULL && file_stat(gz, size, mtime) && size == csize && mtime == cmtime;
+		if(gz) { fclose(gz); }
+	}
+
+	if(!ok)
+	{
+		DEBUG(verb1) << "Gzip index [" << idxfn << "] is corrupt or stale";
+		points.clear();
+	}
+	return ok;
+}
+
+const gzindex::point &gzindex::locate(unsigned long long offset) const
+{
+	// binary search for the last point with p.out <= offset
+	size_t lo = 0, hi = points.size();
+	while(hi - lo > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+		if(points[mid].out <= offset) { lo = mid; } else { hi = mid; }
+	}
+	return points[lo];
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// seekable_streambuf
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+seekable_streambuf::seekable_streambuf(size_t bufsize)
+: fp(NULL), zinit(false), zend(false), inbuf(bufsize), outbuf(bufsize), pos(0)
+{
+	memset(&zs, 0, sizeof(zs));
+	setg(0, 0, 0);
+}
+
+seekable_streambuf::~seekable_streambuf()
+{
+	if(is_open()) { close(); }
+}
+
+seekable_streambuf *seekable_streambuf::open(const char *fn, pgzindex index, bool build, unsigned long long span)
+{
+	if(is_open()) { return NULL; }
+
+	if(!index)
+	{
+		gzindex *gi = new gzindex;
+		index.reset(gi);
+
+		std::string idxfn = gzindex::sidecar(fn);
+		if(!gi->load(idxfn, fn))
+		{
+			if(!build || !gi->build(fn, span)) { return NULL; }
+			gi->save(idxfn);	// failure is not fatal (e.g., read-only directory)
+		}
+	}
+
+	fp = fopen(fn, "rb");
+	if(fp == NULL) { DEBUG(verb1) << "Error opening [" << fn << "]"; return NULL; }
+
+	if(inflateInit2(&zs, -15) != Z_OK)	// raw inflate; the index positions us past the header
+	{
+		fclose(fp); fp = NULL;
+		return NULL;
+	}
+	zinit = true;
+	idx = index;
+
+	if(!restart(idx->points.front())) { close(); return NULL; }
+	return this;
+}
+
+seekable_streambuf *seekable_streambuf::close()
+{
+	if(!is_open()) { return NULL; }
+
+	if(zinit) { inflateEnd(&zs); zinit = false; }
+	bool ok = fclose(fp) == 0;
+	fp = NULL;
+	idx.reset();
+	setg(0, 0, 0);
+
+	return ok ? this : NULL;
+}
+
+bool seekable_streambuf::restart(const gzindex::point &p)
+{
+	if(inflateReset(&zs) != Z_OK) { return false; }
+	zs.avail_in = 0;
+	zend = false;
+
+	if(fseeko(fp, p.in - (p.bits ? 1 : 0), SEEK_SET) != 0) { return false; }
+	if(p.bits)
+	{
+		int c = getc(fp);
+		if(c == EOF) { return false; }
+		if(inflatePrime(&zs, p.bits, c >> (8 - p.bits)) != Z_OK) { return false; }
+	}
+	if(p.out != 0 && inflateSetDictionary(&zs, p.window, gzindex::winsize) != Z_OK) { return false; }
+
+	pos = p.out;
+	setg(&outbuf[0], &outbuf[0], &outbuf[0]);
+	return true;
+}
+
+seekable_streambuf::int_type seekable_streambuf::underflow()
+{
+	if(!is_open()) { return traits_type::eof(); }
+	if(gptr() < egptr()) { return traits_type::to_int_type(*gptr()); }
+
+	pos += egptr() - eback();
+	setg(&outbuf[0], &outbuf[0], &outbuf[0]);
+
+	zs.next_out = (Bytef *)&outbuf[0];
+	zs.avail_out = outbuf.size();
+	while(zs.avail_out == outbuf.size() && !zend)
+	{
+		if(zs.avail_in == 0)
+		{
+			zs.avail_in = fread(&inbuf[0], 1, inbuf.size(), fp);
+			zs.next_in = (Bytef *)&inbuf[0];
+			if(zs.avail_in == 0) { break; }	// truncated file
+		}
+
+		int ret = inflate(&zs, Z_NO_FLUSH);
+		if(ret == Z_STREAM_END) { zend = true; }
+		else if(ret != Z_OK && ret != Z_BUF_ERROR) { DEBUG(verb1) << "Error decompressing gzip stream"; break; }
+	}
+
+	size_t n = outbuf.size() - zs.avail_out;
+	setg(&outbuf[0], &outbuf[0], &outbuf[0] + n);
+	return n ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+}
+
+bool seekable_streambuf::skip(unsigned long long n)
+{
+	while(true)
+	{
+		size_t avail = egptr() - gptr();
+		if(n <= avail) { setg(eback(), gptr() + n, egptr()); return true; }
+
+		n -= avail;
+		setg(eback(), egptr(), egptr());
+		if(traits_type::eq_int_type(underflow(), traits_type::eof())) { return false; }
+	}
+}
+
+seekable_streambuf::pos_type seekable_streambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode mode)
+{
+	if(!is_open() || (mode & std::ios::out)) { return pos_type(off_type(-1)); }
+
+	unsigned long long cur = pos + (gptr() - eback());
+	long long target;
+	switch(dir)
+	{
+		case std::ios::beg: target = off; break;
+		case std::ios::cur: target = cur + off; break;
+		case std::ios::end: target = idx->length + off; break;
+		default: return pos_type(off_type(-1));
+	}
+	if(target < 0 || (unsigned long long)target > idx->length) { return pos_type(off_type(-1)); }
+	if((unsigned long long)target == cur) { return pos_type(target); }
+
+	unsigned long long t = target;
+	if(t >= pos && t <= pos + (egptr() - eback()))
+	{
+		// still within the current buffer
+		setg(eback(), eback() + (t - pos), egptr());
+		return pos_type(target);
+	}
+
+	// decompress through if no access point lies between here and the target
+	const gzindex::point &p = idx->locate(t);
+	if(t < cur || p.out > cur)
+	{
+		if(!restart(p)) { return pos_type(off_type(-1)); }
+		cur = p.out;
+	}
+
+	if(!skip(t - cur)) { return pos_type(off_type(-1)); }
+	return pos_type(target);
+}
+
+seekable_streambuf::pos_type seekable_streambuf::seekpos(pos_type p, std::ios_base::openmode mode)
+{
+	return seekoff(off_type(p), std::ios::beg, mode);
+}
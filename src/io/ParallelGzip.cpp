@@ -0,0 +1,245 @@
+#include <astro/io/gzstream/parallel.h>
+#include <astro/system/log.h>
+
+#include <boost/bind.hpp>
+
+#include <cstring>
+
+using namespace peyton::io::gzstream;
+
+const size_t parallel_streambuf::default_blocksize;
+
+parallel_streambuf::parallel_streambuf(int level_, int nthreads, size_t blocksize_)
+: fp(NULL), level(level_), blocksize(blocksize_), pool(nthreads), crc(0), isize(0), err(false)
+{
+	if(blocksize == 0) { blocksize = default_blocksize; }
+	setp(0, 0);
+}
+
+parallel_streambuf::parallel_streambuf(const char *fn, int level_, int nthreads, size_t blocksize_)
+: fp(NULL), level(level_), blocksize(blocksize_), pool(nthreads), crc(0), isize(0), err(false)
+{
+	if(blocksize == 0) { blocksize = default_blocksize; }
+	setp(0, 0);
+	open(fn);
+}
+
+parallel_streambuf::~parallel_streambuf()
+{
+	if(is_open()) { close(); }
+}
+
+parallel_streambuf *parallel_streambuf::open(const char *fn)
+{
+	if(is_open()) { return NULL; }
+
+	fp = fopen(fn, "wb");
+	if(fp == NULL) { DEBUG(verb1) << "Error opening file [" << fn << "] for writing"; return NULL; }
+	filename = fn;
+
+	crc = crc32(0L, Z_NULL, 0);
+	isize = 0;
+	err = false;
+	dict.clear();
+	pending.clear();
+
+	buf.resize(blocksize);
+	reset_put_area();
+
+	if(!write_header()) { fclose(fp); fp = NULL; return NULL; }
+	return this;
+}
+
+parallel_streambuf *parallel_streambuf::close()
+{
+	if(!is_open()) { return NULL; }
+
+	// the last block is submitted even if empty, to terminate the deflate stream
+	bool ok = submit(true) && drain(0) && write_trailer();
+	ok = (fclose(fp) == 0) && ok;
+	fp = NULL;
+	setp(0, 0);
+
+	if(!ok) { DEBUG(verb1) << "Error writing compressed stream to [" << filename << "]"; }
+	return ok ? this : NULL;
+}
+
+void parallel_streambuf::reset_put_area()
+{
+	setp(&buf[0], &buf[0] + buf.size());
+}
+
+parallel_streambuf::int_type parallel_streambuf::overflow(int_type c)
+{
+	if(!is_open() || err) { return traits_type::eof(); }
+
+	if(pptr() == epptr() && !submit(false)) { return traits_type::eof(); }
+
+	if(!traits_type::eq_int_type(c, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+		return c;
+	}
+	return traits_type::not_eof(c);
+}
+
+int parallel_streambuf::sync()
+{
+	if(!is_open()) { return -1; }
+
+	if(pptr() != pbase() && !submit(false)) { return -1; }
+	if(!drain(0)) { return -1; }
+	return fflush(fp) == 0 ? 0 : -1;
+}
+
+//
+// Hand the contents of the put area to a worker, and remember
+// its tail to prime the compression of the next block
+//
+bool parallel_streambuf::submit(bool last)
+{
+	pblock b(new block);
+	b->in.assign(pbase(), pptr());
+	b->len = b->in.size();
+	b->dict = dict;
+	b->last = last;
+
+	if(b->len >= (size_t)dictsize)
+	{
+		dict.assign(pptr() - dictsize, pptr());
+	}
+	else
+	{
+		dict.insert(dict.end(), pbase(), pptr());
+		if(dict.size() > (size_t)dictsize) { dict.erase(dict.begin(), dict.end() - dictsize); }
+	}
+	reset_put_area();
+
+	pending.push_back(b);
+	pool.submit(boost::bind(&parallel_streambuf::compress, this, b));
+
+	// keep at most two blocks per worker in flight
+	return drain(2*pool.size());
+}
+
+//
+// Executed on a worker thread: raw-deflate a single block
+//
+void parallel_streambuf::compress(pblock b)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	// nothing may escape to the worker: the writer waits for b->done
+	bool ok = false, init = false;
+	try
+	{
+		ok = init = deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+		if(ok && !b->dict.empty())
+		{
+			ok = deflateSetDictionary(&zs, (Bytef *)&b->dict[0], b->dict.size()) == Z_OK;
+		}
+
+		if(ok)
+		{
+			zs.next_in = b->len ? (Bytef *)&b->in[0] : (Bytef *)Z_NULL;
+			zs.avail_in = b->len;
+
+			// the extra bytes leave room for the sync flush marker
+			b->out.resize(deflateBound(&zs, b->len) + 64);
+			size_t have = 0;
+			while(true)
+			{
+				zs.next_out = (Bytef *)&b->out[have];
+				zs.avail_out = b->out.size() - have;
+
+				int ret = deflate(&zs, b->last ? Z_FINISH : Z_SYNC_FLUSH);
+				have = b->out.size() - zs.avail_out;
+
+				if(ret == Z_STREAM_ERROR) { ok = false; break; }
+				if(b->last ? ret == Z_STREAM_END : zs.avail_out != 0) { break; }
+
+				b->out.resize(2*b->out.size());
+			}
+			b->out.resize(have);
+		}
+
+		b->crc = crc32(0L, b->len ? (Bytef *)&b->in[0] : (Bytef *)Z_NULL, b->len);
+	}
+	catch(...)
+	{
+		ok = false;
+	}
+	if(init) { deflateEnd(&zs); }
+
+	std::vector<char>().swap(b->in);
+	std::vector<char>().swap(b->dict);
+
+	{
+		boost::mutex::scoped_lock l(lock);
+		b->failed = !ok;
+		b->done = true;
+	}
+	completed.notify_all();
+}
+
+//
+// Wait for the oldest pending block to finish and append it to the file
+//
+bool parallel_streambuf::write_front()
+{
+	pblock b = pending.front();
+	{
+		boost::mutex::scoped_lock l(lock);
+		while(!b->done) { completed.wait(l); }
+	}
+	pending.pop_front();
+
+	if(b->failed) { err = true; return false; }
+	if(b->out.size() && !put(&b->out[0], b->out.size())) { return false; }
+
+	crc = crc32_combine(crc, b->crc, b->len);
+	isize += b->len;
+	return true;
+}
+
+bool parallel_streambuf::drain(size_t maxpending)
+{
+	bool ok = !err;
+	while(pending.size() > maxpending)
+	{
+		ok = write_front() && ok;
+	}
+	return ok;
+}
+
+bool parallel_streambuf::put(const void *data, size_t len)
+{
+	if(err) { return false; }
+	if(fwrite(data, 1, len, fp) != len) { err = true; }
+	return !err;
+}
+
+bool parallel_streambuf::write_header()
+{
+	// magic, deflate, no flags, no mtime, extra flags, OS = unix
+	unsigned char hdr[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+	if(level == 9) { hdr[8] = 2; }
+	else if(level == 1) { hdr[8] = 4; }
+
+	return put(hdr, sizeof(hdr));
+}
+
+bool parallel_streambuf::write_trailer()
+{
+	unsigned char trl[8];
+	unsigned long sz = (unsigned long)(isize & 0xffffffffULL);
+	for(int i = 0; i != 4; i++)
+	{
+		trl[i]   = (crc >> (8*i)) & 0xff;
+		trl[i+4] = (sz  >> (8*i)) & 0xff;
+	}
+
+	return put(trl, sizeof(trl));
+}
@@ -0,0 +1,224 @@
+//
+// Fast text to number conversion. Floating point numbers are converted
+// with Clinger's fast path where it applies (the decimal significand and
+// the power of ten are both exactly representable, so a single correctly
+// rounded multiplication or division gives the correctly rounded result),
+// and by strtod_l() in the "C" locale otherwise.
+//
+
+#include <astro/io/parse.h>
+
+#include <cstdlib>
+#include <climits>
+#include <limits>
+#include <string>
+#include <locale.h>
+
+using namespace peyton::io;
+
+typedef unsigned long long uint64;
+
+static const double pow10_dbl[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isdigit_(char c) { return (unsigned char)(c - '0') < 10; }
+
+static inline const char *skip_blanks(const char *p, const char *end)
+{
+	while(p != end && (*p == ' ' || *p == '\t')) { ++p; }
+	return p;
+}
+
+//
+// Eight digits at a time, in a 64-bit register ("SWAR"). Only on little
+// endian machines, where the first character lands in the low byte.
+//
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static inline bool eight_digits(const char *p, unsigned &v)
+{
+	uint64 w;
+	memcpy(&w, p, 8);
+	if(((w + 0x4646464646464646ULL) | (w - 0x3030303030303030ULL)) & 0x8080808080808080ULL) { return false; }
+
+	w -= 0x3030303030303030ULL;
+	w = (w * 10) + (w >> 8);
+	w = (((w & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+		(((w >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+	v = (unsigned)w;
+	return true;
+}
+#else
+static inline bool eight_digits(const char *p, unsigned &v) { return false; }
+#endif
+
+//
+// Accumulate a run of decimal digits into w, counting them in ndig
+//
+static inline const char *digits(const char *p, const char *end, uint64 &w, int &ndig)
+{
+	unsigned v;
+	while(end - p >= 8 && ndig <= 11 && eight_digits(p, v))
+	{
+		w = w * 100000000ULL + v;
+		p += 8;
+		ndig += 8;
+	}
+	while(p != end && isdigit_(*p))
+	{
+		if(ndig < 19) { w = w * 10 + (*p - '0'); }
+		ndig++;
+		++p;
+	}
+	return p;
+}
+
+//
+// Case insensitive match of a lowercase word
+//
+static inline bool match(const char *p, const char *end, const char *word)
+{
+	for(; *word; ++p, ++word)
+	{
+		if(p == end || (*p | 0x20) != *word) { return false; }
+	}
+	return true;
+}
+
+static double strtod_c(const char *p, const char *end)
+{
+	static locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+
+	char buf[64];
+	std::string tmp;
+	const char *s;
+	if(end - p < (int)sizeof(buf))
+	{
+		memcpy(buf, p, end - p);
+		buf[end - p] = 0;
+		s = buf;
+	}
+	else
+	{
+		tmp.assign(p, end);
+		s = tmp.c_str();
+	}
+	return strtod_l(s, NULL, c_locale);
+}
+
+const char *parse::number(const char *p, const char *end, double &x)
+{
+	p = skip_blanks(p, end);
+	const char *begin = p;
+
+	bool neg = false;
+	if(p != end && (*p == '-' || *p == '+')) { neg = *p == '-'; ++p; }
+
+	// significand
+	uint64 w = 0;
+	int ndig = 0;
+	const char *q = digits(p, end, w, ndig);
+	bool any = q != p;
+	int nint = ndig;
+	p = q;
+
+	if(p != end && *p == '.')
+	{
+		++p;
+		q = digits(p, end, w, ndig);
+		any = any || q != p;
+		p = q;
+	}
+
+	if(!any)
+	{
+		double d;
+		if(match(p, end, "nan"))		{ p += 3; d = std::numeric_limits<double>::quiet_NaN(); }
+		else if(match(p, end, "infinity"))	{ p += 8; d = std::numeric_limits<double>::infinity(); }
+		else if(match(p, end, "inf"))		{ p += 3; d = std::numeric_limits<double>::infinity(); }
+		else					{ return NULL; }
+
+		x = neg ? -d : d;
+		return p;
+	}
+
+	// exponent
+	int e10 = 0;
+	if(p != end && (*p == 'e' || *p == 'E'))
+	{
+		q = p + 1;
+		bool eneg = false;
+		if(q != end && (*q == '-' || *q == '+')) { eneg = *q == '-'; ++q; }
+		if(q != end && isdigit_(*q))
+		{
+			while(q != end && isdigit_(*q))
+			{
+				if(e10 < 100000) { e10 = 10 * e10 + (*q - '0'); }
+				++q;
+			}
+			if(eneg) { e10 = -e10; }
+			p = q;
+		}
+		// else: a dangling 'e' is not a part of the number
+	}
+
+	// value = w * 10^scale, if no more than 19 digits were given
+	const int scale = e10 - (ndig - nint);
+
+	if(ndig <= 19 && w <= (1ULL << 53) && scale >= -22 && scale <= 22)
+	{
+		double d = (double)w;
+		d = scale < 0 ? d / pow10_dbl[-scale] : d * pow10_dbl[scale];
+		x = neg ? -d : d;
+		return p;
+	}
+	if(w == 0 && ndig <= 19)
+	{
+		x = neg ? -0.0 : 0.0;
+		return p;
+	}
+
+	x = strtod_c(begin, p);
+	return p;
+}
+
+const char *parse::number(const char *p, const char *end, float &x)
+{
+	double d;
+	if((p = number(p, end, d)) == NULL) { return NULL; }
+	x = (float)d;
+	return p;
+}
+
+const char *parse::number(const char *p, const char *end, long long &x)
+{
+	p = skip_blanks(p, end);
+
+	bool neg = false;
+	if(p != end && (*p == '-' || *p == '+')) { neg = *p == '-'; ++p; }
+
+	// skip leading zeros, so that they don't count towards the 19 digit limit
+	const char *q = p;
+	while(q != end && *q == '0') { ++q; }
+
+	uint64 w = 0;
+	int ndig = 0;
+	const char *r = digits(q, end, w, ndig);
+	if(r == p) { return NULL; }
+
+	// 19 digits always fit into an unsigned 64-bit integer
+	if(ndig > 19 || w > (uint64)LLONG_MAX + (neg ? 1 : 0)) { return NULL; }
+
+	x = neg ? (long long)(0ULL - w) : (long long)w;
+	return r;
+}
+
+const char *parse::number(const char *p, const char *end, int &x)
+{
+	long long ll;
+	if((p = number(p, end, ll)) == NULL) { return NULL; }
+	if(ll > INT_MAX || ll < INT_MIN) { return NULL; }
+	x = (int)ll;
+	return p;
+}
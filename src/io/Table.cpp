@@ -0,0 +1,96 @@
+#include <astro/io/table.h>
+#include <astro/system/threadpool.h>
+#include <astro/exceptions.h>
+#include <astro/util.h>
+
+#include <boost/bind.hpp>
+
+using namespace peyton::io;
+using namespace peyton::exceptions;
+
+table_writer::table_writer(std::ostream &out_, const std::string &rowfmt, int nthreads_, size_t bufsize_)
+: out(out_), fmt(rowfmt), bufsize(bufsize_), nthreads(nthreads_), chunk(16384)
+{
+	if(nthreads <= 0) { nthreads = system::ThreadPool::hardware_concurrency(); }
+	buf.reserve(bufsize + 4096);
+}
+
+table_writer::~table_writer()
+{
+	flush();
+	clear_columns();
+}
+
+void table_writer::clear_columns()
+{
+	for(size_t i = 0; i != columns.size(); i++) { delete columns[i]; }
+	columns.clear();
+}
+
+void table_writer::flush()
+{
+	if(buf.empty()) { return; }
+
+	out.write(buf.data(), buf.size());
+	buf.clear();
+}
+
+//
+// Format rows [from, to) of the bound columns, appending them to dest
+//
+void table_writer::format_rows(size_t from, size_t to, std::string *dest) const
+{
+	for(size_t row = from; row != to; row++)
+	{
+		compiled_formatter f = fmt.into(*dest);
+		for(size_t c = 0; c != columns.size(); c++)
+		{
+			columns[c]->format(f, row);
+		}
+	}
+}
+
+void table_writer::write(size_t from, size_t to)
+{
+	if(columns.size() != fmt.specs.size())
+	{
+		THROW(EIOFormat, "Table has " + util::str((int)fmt.specs.size()) + " columns, but " + util::str((int)columns.size()) + " are bound");
+	}
+
+	if(nthreads == 1 || to - from <= chunk)
+	{
+		// serially, straight into the output buffer
+		while(from != to)
+		{
+			size_t end = std::min(to, from + chunk);
+			format_rows(from, end, &buf);
+			if(buf.size() >= bufsize) { flush(); }
+			from = end;
+		}
+		return;
+	}
+
+	// in parallel, in waves of two chunks per thread, writing out
+	// each wave in order once it has been formatted
+	flush();
+
+	system::ThreadPool pool(nthreads);
+	std::vector<std::string> parts(2*nthreads);
+	while(from != to)
+	{
+		size_t n = 0;
+		for(; n != parts.size() && from != to; n++)
+		{
+			size_t end = std::min(to, from + chunk);
+			parts[n].clear();
+			pool.submit(boost::bind(&table_writer::format_rows, this, from, end, &parts[n]));
+			from = end;
+		}
+		pool.wait();
+
+		for(size_t i = 0; i != n; i++)
+		{
+			out.write(parts[i].data(), parts[i].size());
+		}
+	}
+}
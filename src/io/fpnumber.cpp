@@ -41,72 +41,145 @@ void bitprint(unsigned x)
 	std::cerr << " ";
 }
 
-double bitunpack(int m, int k, unsigned v)
+//
+// The packing is done directly on the IEEE-754 representation of
+// doubles, using integer arithmetic only.
+//
+// Normalized formats (k != 0) store x = mint * 2^-(m + e), with the m bit
+// mantissa mint in [2^(m-1), 2^m) (or zero, for x = 0) and the exponent
+// e in [0, 2^k) stored above it. The mantissa is rounded to nearest-even.
+//
+// Denormalized formats (k == 0) store x = v * 2^-m, rounded half up.
+//
+
+typedef unsigned long long uint64;
+
+static inline uint64 dbl_bits(double x)   { uint64 u; memcpy(&u, &x, sizeof(u)); return u; }
+static inline double bits_dbl(uint64 u)   { double x; memcpy(&x, &u, sizeof(x)); return x; }
+
+static inline bool valid_format(int m, int k)
+{
+	return m >= 1 && k >= 0 && m + k <= 32;
+}
+
+static inline int pack_one(int m, int k, double x, unsigned &data)
 {
 	if(k != 0)
 	{
-		unsigned mint = v << (32-m) >> (32-m);
-		
-		int exp;
-		double mantissa = frexp(mint, &exp);
-		exp = -(v >> m);
-	
-		return ldexp(mantissa, exp);
-	} else {
-		double x = 0;
-		for(int i = 0; i != m; i++)
-		{
-			x += (v & 1);
-			x = ldexp(x, -1);
-			v >>= 1;
-		}
-		return x;
+		const uint64 u = dbl_bits(x);
+		if(u << 1 == 0) { data = 0; return BP_OK; }	// +/-0
+		if(u >> 63) { return BP_NEGATIVE; }
+
+		const int be = (int)(u >> 52);			// biased exponent (sign is 0)
+		if(be == 0x7FF) { return (u << 12) ? BP_NEGATIVE : BP_OVERFLOW; }	// nan, inf
+
+		// x = 0.1fff... * 2^-e
+		int e = 1022 - be;
+		if(e < 0) { return BP_OVERFLOW; }
+		if(be == 0) { return BP_UNDERFLOW; }		// denormal doubles are always out of range
+
+		// round the 53 bit significand to m bits, to nearest-even
+		const uint64 full = (u & 0x000FFFFFFFFFFFFFULL) | (1ULL << 52);
+		const int shift = 53 - m;
+		uint64 mint = full >> shift;
+		const uint64 rem = full & ((1ULL << shift) - 1), half = 1ULL << (shift - 1);
+		if(rem > half || (rem == half && (mint & 1))) { mint++; }
+		if(mint >> m) { mint >>= 1; e--; }		// rounded up to the next power of two
+		if(e < 0) { return BP_OVERFLOW; }
+
+		if((uint64)e >= (1ULL << k)) { return BP_UNDERFLOW; }
+
+		data = (unsigned)(((uint64)e << m) | mint);
+		return BP_OK;
+	}
+	else
+	{
+		if(!(x >= 0.)) { return BP_NEGATIVE; }
+		if(x >= 1.) { return BP_OVERFLOW; }
+
+		// y = x * 2^m and its fractional part y - r are exact, while y + 0.5
+		// need not be (eg. y = 0.5 - 2^-54 would round up to 1)
+		const double y = x * (double)(1ULL << m);
+		uint64 r = (uint64)y;
+		if(y - (double)r >= 0.5) { r++; }
+		if(r >> m) { return BP_OVERFLOW; }
+
+		data = (unsigned)r;
+		return BP_OK;
 	}
 }
 
-unsigned bitpack(int m, int k, double x)
+static inline double unpack_one(int m, int k, unsigned v)
 {
-	unsigned data;
 	if(k != 0)
 	{
-		int exp;
+		const unsigned mint = (unsigned)(v & ((1ULL << m) - 1));
+		const int e = (int)((uint64)v >> m);
+
+		// 2^-(m + e), if a normal double
+		const int p = 1023 - m - e;
+		if(p > 0) { return mint * bits_dbl((uint64)p << 52); }
+		return ldexp((double)mint, -(m + e));
+	}
+	else
+	{
+		return (unsigned)(v & ((1ULL << m) - 1)) * (1. / (double)(1ULL << m));
+	}
+}
 
-		double mantissa = frexp(x, &exp);
-		int mint = (int)rint(ldexp(mantissa, m));
+double bitunpack(int m, int k, unsigned v)
+{
+	return unpack_one(m, k, v);
+}
 
-		// error checking
-		exp *= -1;
-		if(exp < 0)  { throw 0; } // only non-positive exponents (|x| <= 1)
-		if(mint < 0) { throw 0; } // only non-negative numbers (x >= 0)
+unsigned bitpack(int m, int k, double x)
+{
+	unsigned data;
+	if(!valid_format(m, k) || pack_one(m, k, x, data) != BP_OK) { throw 0; }
+	return data;
+}
 
-		// range checking
-		if(exp > k) { throw 0; } // smaller than our precision, set to 0
+int bitpack(int m, int k, const double *x, unsigned *v, size_t n, size_t *bad)
+{
+	if(!valid_format(m, k)) { return BP_FORMAT; }
 
-		// storage
-		data = (exp << m) | (mint);
-	} else {
-		if(x < 0) { throw 0; } // only non-negative numbers.
-		if(x >= 1.) { throw 0; } // denormalized numbers have to be < 1
-		data = 0;
-		for(int i = 0; i != m; i++)
+	for(size_t i = 0; i != n; i++)
+	{
+		int ret = pack_one(m, k, x[i], v[i]);
+		if(ret != BP_OK)
 		{
-			data <<= 1;
-			x = ldexp(x, 1);
-			if((int)x)
-			{
-				data |= 1;
-				x -= 1.;
-			}
+			if(bad) { *bad = i; }
+			return ret;
 		}
-		// rounding
-		if(x >= 0.5)
+	}
+	return BP_OK;
+}
+
+int bitunpack(int m, int k, const unsigned *v, double *x, size_t n)
+{
+	if(!valid_format(m, k)) { return BP_FORMAT; }
+
+	if(k == 0)
+	{
+		const double scale = 1. / (double)(1ULL << m);
+		const unsigned mask = (unsigned)((1ULL << m) - 1);
+		for(size_t i = 0; i != n; i++) { x[i] = (v[i] & mask) * scale; }
+	}
+	else if(m + ((1LL << k) - 1) < 1023)
+	{
+		// all exponents map to normal doubles
+		const unsigned mask = (unsigned)((1ULL << m) - 1);
+		for(size_t i = 0; i != n; i++)
 		{
-			data += 1; // remarkably, but in this representation, this is all it takes!
-			if(data & (1 << m)) { throw 0; } // overflow
+			const uint64 p = 1023 - m - (int)((uint64)v[i] >> m);
+			x[i] = (v[i] & mask) * bits_dbl(p << 52);
 		}
 	}
-
-	return data;
+	else
+	{
+		for(size_t i = 0; i != n; i++) { x[i] = unpack_one(m, k, v[i]); }
+	}
+	return BP_OK;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -135,12 +208,12 @@ public:
 	iostate(fpnumber::format f_ = format(12, 2), int fmt_ = 0)
 		: out(NULL), f(f_), fmtflags(fmt_), ptr(0), putptr(-1), unit(8*sizeof(unsigned))
 	{
-		for(int i = 0; i != sizeof(bitbuffer); i++) { bitbuffer[i] = 0; }
+		for(int i = 0; i != sizeof(bitbuffer)/sizeof(block); i++) { bitbuffer[i] = 0; }
 	}
 	iostate(const iostate &cpy)
 		: out(NULL), f(cpy.f), fmtflags(cpy.fmtflags), ptr(0), putptr(-1), unit(8*sizeof(unsigned))
 	{
-		for(int i = 0; i != sizeof(bitbuffer); i++) { bitbuffer[i] = 0; }
+		for(int i = 0; i != sizeof(bitbuffer)/sizeof(block); i++) { bitbuffer[i] = 0; }
 	}
 	void flush();
 public:
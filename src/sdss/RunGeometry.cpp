@@ -4,6 +4,7 @@
 #include <astro/system/log.h>
 #include <astro/constants.h>
 #include <astro/coordinates.h>
+#include <astro/io/parse.h>
 
 #include <fstream>
 #include <stdio.h>
@@ -94,10 +95,12 @@ RunGeometryDB::RunGeometryDB()
 		f.getline(buf, 1000);
 		if(strlen(buf) < 3 || buf[0] == '#') continue;
 
-		int n = sscanf(buf, "%d %lf %lf %lf %lf %lf %lf %lf %lf", 
-			&geom.run, &geom.ra, &geom.dec, &geom.tstart, &geom.tend,
-			&geom.node, &geom.inc, &geom.muStart, &geom.nu);
-		if(n != 9) continue;
+		const char *p = buf, *end = buf + strlen(buf);
+		if(!(io::parse::next(p, end, geom.run) &&
+			io::parse::next(p, end, geom.ra) && io::parse::next(p, end, geom.dec) &&
+			io::parse::next(p, end, geom.tstart) && io::parse::next(p, end, geom.tend) &&
+			io::parse::next(p, end, geom.node) && io::parse::next(p, end, geom.inc) &&
+			io::parse::next(p, end, geom.muStart) && io::parse::next(p, end, geom.nu))) continue;
 
 		// correct the time to time of center of the frame
 		geom.tstart += toffset;
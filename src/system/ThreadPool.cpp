@@ -0,0 +1,100 @@
+#include <astro/system/threadpool.h>
+#include <astro/exceptions.h>
+
+#include <boost/bind.hpp>
+
+using namespace peyton::system;
+using namespace peyton::exceptions;
+
+int ThreadPool::hardware_concurrency()
+{
+	int n = boost::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+ThreadPool::ThreadPool(int nthreads)
+: running(0), stopping(false)
+{
+	if(nthreads <= 0) { nthreads = hardware_concurrency(); }
+
+	for(int i = 0; i != nthreads; i++)
+	{
+		workers.create_thread(boost::bind(&ThreadPool::worker, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		boost::mutex::scoped_lock l(lock);
+		stopping = true;
+	}
+	haswork.notify_all();
+	workers.join_all();
+}
+
+void ThreadPool::submit(const job_t &job)
+{
+	{
+		boost::mutex::scoped_lock l(lock);
+		jobs.push_back(job);
+	}
+	haswork.notify_one();
+}
+
+void ThreadPool::wait() throw(EThreadPool)
+{
+	std::string err;
+	{
+		boost::mutex::scoped_lock l(lock);
+		while(!jobs.empty() || running) { idle.wait(l); }
+		err.swap(error);
+	}
+
+	if(!err.empty())
+	{
+		THROW(EThreadPool, "A job executed by the thread pool has failed: " + err);
+	}
+}
+
+void ThreadPool::worker()
+{
+	while(true)
+	{
+		job_t job;
+		{
+			boost::mutex::scoped_lock l(lock);
+			while(jobs.empty() && !stopping) { haswork.wait(l); }
+			if(jobs.empty()) { return; }	// stopping, and nothing left to do
+
+			job.swap(jobs.front());
+			jobs.pop_front();
+			running++;
+		}
+
+		std::string err;
+		try
+		{
+			job();
+		}
+		catch(EAny &e)
+		{
+			err = e.info.empty() ? std::string("unknown error") : e.info;
+		}
+		catch(std::exception &e)
+		{
+			err = e.what();
+		}
+		catch(...)
+		{
+			err = "unknown error";
+		}
+
+		{
+			boost::mutex::scoped_lock l(lock);
+			running--;
+			if(!err.empty() && error.empty()) { error = err; }
+		}
+		idle.notify_all();
+	}
+}